@@ -0,0 +1,243 @@
+/* arena.hpp -- v1.0 -- bump allocator for handler scratch memory
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_ARENA_HPP
+#define _COMM_ARENA_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace comm {
+
+    static const std::size_t ARENA_CHUNK_SIZE = 1 << 16;
+    static const std::size_t CONNECTION_ARENA_CHUNK_SIZE = 1 << 12;
+
+    //! @class arena
+    /*! bump allocator over a list of chunks; memory is only reclaimed in bulk by reset() or destruction.
+     *  Chunks are kept across resets, so a warmed-up arena doesn't call malloc; allocations larger than
+     *  a chunk get a dedicated block that reset() frees. Not thread-safe.
+     */
+    class arena {
+    public:
+
+        //! dtor.
+        //!
+        ~arena() {
+            release();
+        }
+
+        //! ctor.
+        //! @param chunksize    bytes per chunk, allocated on first use
+        explicit arena(const std::size_t chunksize = ARENA_CHUNK_SIZE) : head_(nullptr)
+                                                                       , cur_(nullptr)
+                                                                       , large_(nullptr)
+                                                                       , pos_(nullptr)
+                                                                       , end_(nullptr)
+                                                                       , chunksize_(chunksize) {  }
+
+        //! Move ctor.
+        //!
+        arena(arena&& other) noexcept : head_(other.head_)
+                                      , cur_(other.cur_)
+                                      , large_(other.large_)
+                                      , pos_(other.pos_)
+                                      , end_(other.end_)
+                                      , chunksize_(other.chunksize_) {
+
+            other.head_ = other.cur_ = other.large_ = nullptr;
+            other.pos_ = other.end_ = nullptr;
+        }
+
+        //! Allocates uninitialised memory
+        //! @param size     bytes
+        //! @param align    alignment, a power of two
+        //! @return         memory valid until the next reset()
+        void* allocate(const std::size_t size, const std::size_t align = alignof(std::max_align_t)) {
+
+            char* const p = align_up(pos_, align);
+            if (p && p + size <= end_)
+            {
+                pos_ = p + size;
+                return p;
+            }
+
+            return allocate_slow(size, align);
+        }
+
+        //! Constructs an object in the arena; its destructor is never run
+        //! @param args    ctor arguments
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        }
+
+        //! Allocates an uninitialised array
+        //! @param n    element count
+        template <typename T>
+        T* make_array(const std::size_t n) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena objects are never destroyed");
+            return static_cast<T*>(allocate(n * sizeof(T), alignof(T)));
+        }
+
+        //! Invalidates all allocations, keeps chunks for reuse
+        //!
+        void reset() {
+
+            // Nothing allocated since the last reset
+            if (cur_ == head_ && (head_ == nullptr || pos_ == data(head_)) && large_ == nullptr)
+                return;
+
+            free_list(large_);
+            large_ = nullptr;
+
+            cur_ = head_;
+            pos_ = head_ ? data(head_) : nullptr;
+            end_ = head_ ? pos_ + chunksize_ : nullptr;
+        }
+
+        //! Frees all memory
+        //!
+        void release() {
+
+            free_list(head_);
+            free_list(large_);
+
+            head_ = cur_ = large_ = nullptr;
+            pos_ = end_ = nullptr;
+        }
+
+    private:
+
+        /*! @struct chunk
+         *  chunk header, followed by its memory
+         */
+        struct alignas(std::max_align_t) chunk {
+            chunk* next;
+        };
+
+        chunk* head_;    // first chunk
+        chunk* cur_;     // chunk being filled
+        chunk* large_;   // dedicated blocks, freed on reset
+        char* pos_;      // next free byte in cur_
+        char* end_;      // end of cur_
+
+        std::size_t chunksize_;
+
+        /*! Impl.
+         */
+        static char* data(chunk* const c) {
+            return reinterpret_cast<char*>(c + 1);
+        }
+
+        /*! Impl.
+         */
+        static char* align_up(char* const p, const std::size_t align) {
+            const std::uintptr_t a = reinterpret_cast<std::uintptr_t>(p);
+            return reinterpret_cast<char*>((a + align - 1) & ~static_cast<std::uintptr_t>(align - 1));
+        }
+
+        /*! Impl.
+         */
+        static chunk* new_chunk(const std::size_t size) {
+
+            chunk* const c = static_cast<chunk*>(std::malloc(sizeof(chunk) + size));
+            if (c == nullptr)
+                throw std::bad_alloc();
+
+            c->next = nullptr;
+            return c;
+        }
+
+        /*! Impl.
+         */
+        static void free_list(chunk* c) {
+            while (c)
+            {
+                chunk* const next = c->next;
+                std::free(c);
+                c = next;
+            }
+        }
+
+        /*! Moves to the next chunk, or allocates a dedicated block for oversized requests
+         */
+        void* allocate_slow(const std::size_t size, const std::size_t align) {
+
+            if (size + align > chunksize_)
+            {
+                chunk* const c = new_chunk(size + align);
+                c->next = large_;
+                large_ = c;
+                return align_up(data(c), align);
+            }
+
+            chunk* next = cur_ ? cur_->next : head_;
+            if (next == nullptr)
+            {
+                next = new_chunk(chunksize_);
+
+                if (cur_)
+                    cur_->next = next;
+                else
+                    head_ = next;
+            }
+
+            cur_ = next;
+            end_ = data(cur_) + chunksize_;
+
+            char* const p = align_up(data(cur_), align);
+            pos_ = p + size;
+            return p;
+        }
+
+        // Non-copyable object
+        explicit arena(arena&) = delete;
+        explicit arena(const arena&) = delete;
+    };
+
+    //! @class arena_allocator
+    /*! standard allocator over an arena, e.g. for containers built inside a handler; deallocate is a no-op
+     */
+    template <typename T>
+    class arena_allocator {
+    public:
+
+        typedef T value_type;
+
+        //! ctor.
+        //! @param a    backing arena
+        explicit arena_allocator(arena& a) noexcept : arena_(&a) {  }
+
+        template <typename U>
+        arena_allocator(const arena_allocator<U>& other) noexcept : arena_(other.arena_) {  }
+
+        T* allocate(const std::size_t n) {
+            return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+        }
+
+        void deallocate(T*, std::size_t) noexcept {  }
+
+        template <typename U>
+        bool operator==(const arena_allocator<U>& other) const noexcept {
+            return arena_ == other.arena_;
+        }
+
+        template <typename U>
+        bool operator!=(const arena_allocator<U>& other) const noexcept {
+            return arena_ != other.arena_;
+        }
+
+    private:
+
+        template <typename> friend class arena_allocator;
+
+        arena* arena_;
+    };
+}
+
+#endif
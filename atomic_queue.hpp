@@ -5,15 +5,39 @@
 #define _COMM_ATOMIC_QUEUE_HPP
 
 #include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
 
 #include "mem.hpp"
 
+#ifdef COMM_CONTENTION_STATS
+#define COMM_CONTENTION_INIT() (contention_ = make_counters())
+#define COMM_CONTENTION_COUNT(field) contention_->field.fetch_add(1, std::memory_order_relaxed)
+#else
+#define COMM_CONTENTION_INIT() ((void)0)
+#define COMM_CONTENTION_COUNT(field) ((void)0)
+#endif
+
 namespace comm {
 
+#ifdef COMM_CONTENTION_STATS
+    //! @struct queue_contention
+    /*! contention counters of an atomic_queue, built with COMM_CONTENTION_STATS
+     */
+    struct queue_contention {
+        std::uint64_t cas_failures;   // roll-over compare_exchange that lost a race
+        std::uint64_t spins;          // iterations waiting for other threads to pass the roll-over point
+    };
+#endif
+
     //! @class circular queue
-    /*! thread-safe circular queue with lock-free concurrency control
+    /*! thread-safe circular queue with lock-free concurrency control. Indices run up to a few slots
+     *  past the capacity before rolling over; a mirrored allocator (see mem.hpp) maps those onto the
+     *  start of the buffer, otherwise they are folded back on access.
      */
-    template <typename T>
+    template <typename T, typename Talloc = mirror_alloc>
     class atomic_queue {
     public:
 
@@ -24,6 +48,7 @@ namespace comm {
             ok_.store(false);
             head_.store(0);
             tail_.store(0);
+            COMM_CONTENTION_INIT();
         }
 
         //! ctor.
@@ -31,7 +56,8 @@ namespace comm {
         //!                        will be expanded up to page size border
         explicit atomic_queue(std::size_t capacityHint) {
 
-            buff_ = static_cast<T*>(gen_memmap<T>(&capacityHint));
+            COMM_CONTENTION_INIT();
+            buff_ = alloc_array<Talloc, T>(&capacityHint);
             capacity_ = capacityHint;
             ok_.store(true);
             head_.store(0);
@@ -55,7 +81,7 @@ namespace comm {
         void destroy() {
 
             if (ok_.exchange(false)) {
-                del_memmap<T>(buff_, capacity_);
+                free_array<Talloc>(buff_, capacity_);
             }
         }
 
@@ -64,13 +90,15 @@ namespace comm {
         void enqueue(const T& data) {
 
             int t = tail_.fetch_add(1);
-            buff_[t++] = data;
+            at(t++) = data;
 
             // Maybe roll over
             if (capacity_ <= t)
             {
-                while (tail_.load() > t) {  }
-                tail_.compare_exchange_strong(t, t - capacity_, std::memory_order_relaxed);
+                while (tail_.load() > t) { COMM_CONTENTION_COUNT(spins); }
+
+                if (!tail_.compare_exchange_strong(t, t - capacity_, std::memory_order_relaxed))
+                    COMM_CONTENTION_COUNT(cas_failures);
             }
         }
 
@@ -79,20 +107,57 @@ namespace comm {
         T dequeue() {
 
             int h = head_.fetch_add(1);
-            const T data = buff_[h++];
+            const T data = at(h++);
 
             // Maybe roll over
             if (capacity_ <= h)
             {
-                while (head_.load() > h) {  }
-                head_.compare_exchange_strong(h, h - capacity_, std::memory_order_relaxed);
+                while (head_.load() > h) { COMM_CONTENTION_COUNT(spins); }
+
+                if (!head_.compare_exchange_strong(h, h - capacity_, std::memory_order_relaxed))
+                    COMM_CONTENTION_COUNT(cas_failures);
             }
 
             return data;
         }
 
+#ifdef COMM_CONTENTION_STATS
+        /*! Snapshot of the contention counters
+         */
+        queue_contention contention() const {
+            queue_contention c;
+            c.cas_failures = contention_->cas_failures.load(std::memory_order_relaxed);
+            c.spins = contention_->spins.load(std::memory_order_relaxed);
+            return c;
+        }
+
+        ~atomic_queue() {
+            contention_->~counters();
+            std::free(contention_);
+        }
+
+        /*! Field addresses, to match perf c2c cache lines to fields
+         */
+        const void* head_address() const { return &head_; }
+        const void* tail_address() const { return &tail_; }
+#endif
+
     private:
 
+        /*! Slot of an index
+         */
+        T& at(const int i) {
+            return at(i, std::integral_constant<bool, Talloc::mirrored>());
+        }
+
+        T& at(const int i, std::true_type) {
+            return buff_[i];
+        }
+
+        T& at(const int i, std::false_type) {
+            return buff_[i < capacity_ ? i : i - capacity_];
+        }
+
         // Buffer
         T* buff_;
         // Buffer capacity
@@ -102,6 +167,28 @@ namespace comm {
         std::atomic<bool> ok_;
         // Circular queue pointer head and tail
         std::atomic<int> head_, tail_;
+
+#ifdef COMM_CONTENTION_STATS
+        // Kept out of line on their own cache line, so the counters don't add sharing of their own;
+        // the pointer still follows head_ and tail_, so the instrumented layout differs by it
+        struct counters {
+            std::atomic<std::uint64_t> cas_failures, spins;
+            counters() : cas_failures(0), spins(0) {  }
+        }* contention_;
+
+        /*! Impl.
+         */
+        static counters* make_counters() {
+
+            static_assert(sizeof(counters) <= 64, "contention counters exceed a cache line");
+
+            void* const mem = ::aligned_alloc(64, 64);
+            if (mem == nullptr)
+                throw std::bad_alloc();
+
+            return new (mem) counters();
+        }
+#endif
     };
 }
 
@@ -0,0 +1,318 @@
+/* buffer.hpp -- v1.0 -- pooled, refcounted receive buffers and the slices that share them
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_BUFFER_HPP
+#define _COMM_BUFFER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#include "client.hpp"
+
+namespace comm {
+
+    // Buffer sizes grow by 4x per tier, 256 bytes to 64 KiB
+    static const int BUFFER_TIERS = 5;
+    // Bytes of free buffers a thread keeps per tier before returning them to malloc
+    static const std::size_t BUFFER_CACHE_BYTES = 4 << 20;
+
+    //! Returns the capacity of a buffer tier
+    //! @param tier    0 to BUFFER_TIERS - 1
+    inline constexpr std::size_t buffer_capacity(const int tier) {
+        return static_cast<std::size_t>(256) << (2 * tier);
+    }
+
+    //! Returns the smallest tier holding a number of bytes, the largest tier if none does
+    //! @param size    bytes
+    inline int buffer_tier(const std::size_t size) {
+        int tier = 0;
+        while (tier != BUFFER_TIERS - 1 && buffer_capacity(tier) < size)
+            ++tier;
+        return tier;
+    }
+
+    // Tier of MAX_READ_SIZE buffers
+    static const int BUFFER_DEFAULT_TIER = 2;
+    static_assert(buffer_capacity(BUFFER_DEFAULT_TIER) == MAX_READ_SIZE, "default tier must match MAX_READ_SIZE");
+
+    class buffer_pool;
+
+    //! @struct buffer
+    /*! refcounted block of one tier's capacity, returned to its owning thread's pool on last release.
+     *  One byte past the capacity is allocated, so received data can be terminated in place.
+     */
+    struct buffer {
+        std::atomic<std::uint32_t> refs;
+        std::uint32_t tier;
+        buffer_pool* owner;
+        buffer* next;
+
+        char* data() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+
+        std::size_t capacity() const {
+            return buffer_capacity(tier);
+        }
+    };
+
+    //! @class buffer_pool
+    /*! per-thread free lists of buffers, one per tier. The owning thread allocates and releases without atomics beyond the
+     *  buffer's refcount; other threads push released buffers onto a lock-free stack that the owner takes
+     *  over in one exchange when its own list runs dry. The pool outlives its thread until its last
+     *  buffer is released.
+     */
+    class buffer_pool {
+    public:
+
+        //! Returns the calling thread's pool
+        static buffer_pool& local() {
+            static thread_local holder h;
+            return *h.pool;
+        }
+
+        //! Takes a buffer with one reference
+        //! @param tier    size tier
+        buffer* acquire(const int tier = BUFFER_DEFAULT_TIER) {
+
+            buffer*& free = free_[tier];
+
+            if (free == nullptr)
+            {
+                free = remote_[tier].exchange(nullptr, std::memory_order_acquire);
+
+                nfree_[tier] = 0;
+                for (buffer* b = free; b; b = b->next)
+                    ++nfree_[tier];
+            }
+
+            buffer* b = free;
+            if (b)
+            {
+                free = b->next;
+                --nfree_[tier];
+            }
+
+            else
+            {
+                b = static_cast<buffer*>(std::malloc(sizeof(buffer) + buffer_capacity(tier) + 1));
+                if (b == nullptr)
+                    throw std::bad_alloc();
+
+                b->tier = tier;
+                b->owner = this;
+            }
+
+            b->refs.store(1, std::memory_order_relaxed);
+            refs_.fetch_add(1, std::memory_order_relaxed);
+
+            return b;
+        }
+
+        //! Drops a reference, the last one returns the buffer to its owner
+        //! @param b    buffer
+        static void release(buffer* const b) {
+
+            if (b->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+                return;
+
+            buffer_pool* const owner = b->owner;
+            const int tier = b->tier;
+
+            if (owner == local_pool())
+            {
+                if (owner->nfree_[tier] * buffer_capacity(tier) < BUFFER_CACHE_BYTES)
+                {
+                    b->next = owner->free_[tier];
+                    owner->free_[tier] = b;
+                    ++owner->nfree_[tier];
+                }
+
+                else
+                    std::free(b);
+            }
+
+            else
+            {
+                std::atomic<buffer*>& remote = owner->remote_[tier];
+
+                b->next = remote.load(std::memory_order_relaxed);
+                while (!remote.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed))
+                    ;
+            }
+
+            owner->unref();
+        }
+
+    private:
+
+        // Buffers cached by the owning thread, per tier
+        buffer* free_[BUFFER_TIERS];
+        std::size_t nfree_[BUFFER_TIERS];
+        // Buffers released by other threads, per tier
+        std::atomic<buffer*> remote_[BUFFER_TIERS];
+        // Outstanding buffers plus one for the owning thread
+        std::atomic<std::size_t> refs_;
+
+        /*! @struct holder
+         *  thread-local owner reference, dropped on thread exit
+         */
+        struct holder {
+            buffer_pool* pool;
+
+            holder() : pool(new buffer_pool()) {
+                local_pool() = pool;
+            }
+
+            ~holder() {
+                local_pool() = nullptr;
+
+                for (int i = 0; i != BUFFER_TIERS; ++i)
+                {
+                    free_list(pool->free_[i]);
+                    pool->free_[i] = nullptr;
+                }
+
+                pool->unref();
+            }
+        };
+
+        buffer_pool() : refs_(1) {
+
+            for (int i = 0; i != BUFFER_TIERS; ++i)
+            {
+                free_[i] = nullptr;
+                nfree_[i] = 0;
+                remote_[i].store(nullptr);
+            }
+        }
+
+        ~buffer_pool() {
+            for (int i = 0; i != BUFFER_TIERS; ++i)
+            {
+                free_list(free_[i]);
+                free_list(remote_[i].load());
+            }
+        }
+
+        /*! Impl.
+         */
+        static buffer_pool*& local_pool() {
+            static thread_local buffer_pool* p = nullptr;
+            return p;
+        }
+
+        /*! Impl.
+         */
+        static void free_list(buffer* b) {
+            while (b)
+            {
+                buffer* const next = b->next;
+                std::free(b);
+                b = next;
+            }
+        }
+
+        /*! Impl.
+         */
+        void unref() {
+            if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                delete this;
+        }
+
+        // Non-copyable object
+        explicit buffer_pool(buffer_pool&) = delete;
+        explicit buffer_pool(const buffer_pool&) = delete;
+    };
+
+    //! @class slice
+    /*! owning view of part of a buffer; copies share the buffer, which is released with the last slice.
+     *  A slice may be kept past the callback and moved to, or released on, any thread.
+     */
+    class slice {
+    public:
+
+        //! dtor.
+        //!
+        ~slice() {
+            reset();
+        }
+
+        //! ctor.
+        //!
+        slice() noexcept : buff_(nullptr), data_(nullptr), size_(0) {  }
+
+        //! ctor.
+        //! @param b       buffer, its reference is adopted
+        //! @param size    bytes from the start of the buffer
+        slice(buffer* const b, const std::size_t size) noexcept : buff_(b), data_(b->data()), size_(size) {  }
+
+        //! Copy ctor., shares the buffer
+        //!
+        slice(const slice& other) noexcept : buff_(other.buff_), data_(other.data_), size_(other.size_) {
+            if (buff_)
+                buff_->refs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        //! Move ctor.
+        //!
+        slice(slice&& other) noexcept : buff_(other.buff_), data_(other.data_), size_(other.size_) {
+            other.buff_ = nullptr;
+            other.data_ = nullptr;
+            other.size_ = 0;
+        }
+
+        //! Assignment, copy or move
+        //!
+        slice& operator=(slice other) noexcept {
+            std::swap(buff_, other.buff_);
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+            return *this;
+        }
+
+        //! Returns a slice of part of this one, sharing the buffer
+        //! @param offset    start, relative to this slice
+        //! @param size      bytes
+        slice sub(const std::size_t offset, const std::size_t size) const {
+            slice s(*this);
+            s.data_ += offset;
+            s.size_ = size;
+            return s;
+        }
+
+        //! Releases the buffer
+        //!
+        void reset() {
+            if (buff_)
+                buffer_pool::release(buff_);
+
+            buff_ = nullptr;
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        char* data() const {
+            return data_;
+        }
+
+        std::size_t size() const {
+            return size_;
+        }
+
+        bool empty() const {
+            return size_ == 0;
+        }
+
+    private:
+
+        buffer* buff_;
+        char* data_;
+        std::size_t size_;
+    };
+}
+
+#endif
@@ -0,0 +1,155 @@
+/* capture.hpp -- v1.0 -- compact memory-mapped capture of inbound traffic, for deterministic replay
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_CAPTURE_HPP
+#define _COMM_CAPTURE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "worker.hpp"
+
+namespace comm {
+
+    static const std::uint64_t CAPTURE_MAGIC = 0x315041434d4d4f43ULL; // "COMMCAP1"
+
+    //! Record types, stored in the upper two bits of capture_record::size
+    enum capture_type : std::uint32_t {
+        CAPTURE_DATA = 0,
+        CAPTURE_OPEN = 1u << 30,
+        CAPTURE_CLOSE = 2u << 30
+    };
+
+    static const std::uint32_t CAPTURE_TYPE_MASK = 3u << 30;
+
+    //! @struct capture_header
+    /*! file header, followed by records
+     */
+    struct capture_header {
+        std::uint64_t magic;
+        std::uint64_t capacity;           // file size
+        std::atomic<std::uint64_t> used;  // bytes reserved, including the header
+        std::atomic<std::uint64_t> dropped;  // records that didn't fit
+    };
+
+    //! @struct capture_record
+    /*! record header, followed by the payload padded to 8 bytes
+     */
+    struct capture_record {
+        std::uint64_t ts;     // CLOCK_MONOTONIC, nsec
+        std::uint32_t conn;   // connection id, reused after CAPTURE_CLOSE
+        std::uint32_t size;   // capture_type | payload length, 0 until the record is complete
+    };
+
+    //! @class capture_file
+    /*! lock-free writer of a capture file; records are reserved with a compare-and-swap on the used
+     *  size, which never moves past the capacity, and written in place
+     */
+    class capture_file {
+    public:
+
+        //! dtor.
+        //!
+        ~capture_file() {
+
+            const std::uint64_t used = hdr_->used.load();
+            ::munmap(hdr_, capacity_);
+
+            // Trim unused space
+            if (used < capacity_)
+                ::truncate(path_, used);
+        }
+
+        //! ctor.
+        //! @param path        output file, truncated
+        //! @param capacity    maximum file size; records past it are dropped
+        capture_file(const char* path, const std::size_t capacity) : capacity_(capacity) {
+
+            std::strncpy(path_, path, sizeof(path_) - 1);
+            path_[sizeof(path_) - 1] = '\0';
+
+            int fd;
+            if ((fd = ::open(path, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC, 0644)) == -1)
+                throw std::runtime_error("failed to create capture file");
+
+            if (::ftruncate(fd, capacity) == -1)
+            {
+                ::close(fd);
+                throw std::runtime_error("failed to create capture file");
+            }
+
+            void* const mem = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ::close(fd);
+
+            if (mem == MAP_FAILED)
+                throw std::runtime_error("failed to create capture file");
+
+            hdr_ = static_cast<capture_header*>(mem);
+            hdr_->magic = CAPTURE_MAGIC;
+            hdr_->capacity = capacity;
+            hdr_->used.store(sizeof(capture_header));
+            hdr_->dropped.store(0);
+        }
+
+        //! Appends a record, callable from any thread
+        //! @param conn       connection id
+        //! @param type       record type
+        //! @param data       payload
+        //! @param datalen    payload length
+        void record(const std::uint32_t conn,
+                    const capture_type type,
+                    const void* data = nullptr,
+                    const std::uint32_t datalen = 0)
+        {
+            const std::uint64_t size = sizeof(capture_record) + ((datalen + 7) & ~7u);
+
+            // Stamped before reserving so that file order mostly follows time; writers racing for the
+            // offset can still land slightly out of order
+            const std::uint64_t ts = detail::now();
+
+            // A reservation is only made if it fits, so there is nothing to roll back that a concurrent
+            // writer could have reserved past
+            std::uint64_t off = hdr_->used.load(std::memory_order_relaxed);
+            do
+            {
+                if (off + size > capacity_)
+                {
+                    hdr_->dropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+                }
+            }
+            while (!hdr_->used.compare_exchange_weak(off, off + size, std::memory_order_relaxed));
+
+            capture_record* const rec = reinterpret_cast<capture_record*>(reinterpret_cast<char*>(hdr_) + off);
+            rec->ts = ts;
+            rec->conn = conn;
+
+            if (datalen)
+                std::memcpy(rec + 1, data, datalen);
+
+            // Size is stored last, readers stop at the first incomplete record
+            __atomic_store_n(&rec->size, type | datalen, __ATOMIC_RELEASE);
+        }
+
+    private:
+
+        capture_header* hdr_;
+        std::size_t capacity_;
+
+        char path_[256];
+
+        // Non-copyable object
+        explicit capture_file(capture_file&) = delete;
+        explicit capture_file(const capture_file&) = delete;
+    };
+}
+
+#endif
@@ -1,24 +1,54 @@
-/* client.hpp -- v1.0 -- the client data structure, containing file descriptor and pointer to buffer
+/* client.hpp -- v1.0 -- the client data structure, per-connection state off the hot path
    Author: Sam Y. 2021-22 */
 
 #ifndef _COMM_CLIENT_HPP
 #define _COMM_CLIENT_HPP
 
+#include <atomic>
+#include <cstdint>
+
 namespace comm {
 
+    class arena;
+    struct buffer;
+
     static const int MAX_READ_SIZE = 4096;
+    // Destinations a handler can supply for one read
+    static const int MAX_READ_TARGETS = 8;
 
     //! @struct client
-    /* remote connection endpoint
+    /* remote connection endpoint; the socket and other fields scanned across connections live in the
+     * pool's connection_table under the same slot
      */
     struct client {
 
-        int sfd;
-
-        static const int size = MAX_READ_SIZE;
-        char buff[size + 1];
-
-        explicit client(const int s) : sfd(s) {  }
+        // Index of the accepting listener
+        std::uint32_t listener;
+        // Reads since connect, paces TCP_INFO sampling
+        std::uint32_t nreads;
+        // tcpi_total_retrans at the last sample
+        std::uint32_t retrans;
+
+        // Tier of the receive buffer, and consecutive reads that would have fit the next smaller tier
+        std::uint8_t tier;
+        std::uint8_t small;
+        // Set by client_pool::disconnect() to close with RST, counted when the worker closes it
+        std::atomic<std::uint8_t> reset;
+
+        // Per-connection arena, created on first use and freed on close
+        arena* scratch;
+        // Receive buffer, taken from the tiered pools on first read and resized with the read history
+        buffer* rbuff;
+
+        explicit client(const std::uint32_t l = 0,
+                        const std::uint8_t t = 0) : listener(l)
+                                                  , nreads(0)
+                                                  , retrans(0)
+                                                  , tier(t)
+                                                  , small(0)
+                                                  , reset(0)
+                                                  , scratch(nullptr)
+                                                  , rbuff(nullptr) {  }
     };
 }
 
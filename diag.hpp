@@ -0,0 +1,343 @@
+/* diag.hpp -- v1.0 -- kernel accept queue and socket buffer monitoring through NETLINK_SOCK_DIAG
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_DIAG_HPP
+#define _COMM_DIAG_HPP
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "stats.hpp"
+
+namespace comm {
+
+    //! @struct listener_diag
+    /*! kernel view of one listener and the connections on its port
+     */
+    struct listener_diag {
+        int fd;
+        std::uint16_t port;
+        std::uint64_t inode;
+
+        std::uint32_t queued;    // connections waiting in the accept queue
+        std::uint32_t backlog;   // accept queue limit
+        std::uint64_t conns;     // connections on the listener's port
+
+        histogram rxqueue;       // unread bytes per connection
+        histogram txqueue;       // unsent or unacknowledged bytes per connection
+    };
+
+    //! @class sock_diag
+    /*! queries NETLINK_SOCK_DIAG for accept queue depth of a set of listeners and the
+     *  receive/send queue occupancy of their connections. Dumps carry a bytecode filter on the
+     *  listeners' ports, so the kernel doesn't return the host's other sockets. Not thread-safe.
+     */
+    class sock_diag {
+    public:
+
+        //! dtor.
+        //!
+        ~sock_diag() {
+            ::close(nlfd_);
+        }
+
+        //! ctor.
+        //! @param listeners    listener descriptors, listener index is the position in this vector
+        explicit sock_diag(const std::vector<int>& listeners) : buff_(DIAG_BUFF_SIZE)
+                                                              , overflows_(0)
+                                                              , drops_(0) {
+
+            if ((nlfd_ = ::socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG)) == -1)
+                throw std::runtime_error("failed to create sock_diag socket");
+
+            for (std::size_t i = 0; i != listeners.size(); ++i)
+            {
+                listener_diag l = {  };
+                l.fd = listeners[i];
+
+                struct sockaddr_storage addr = {  };
+                socklen_t len = sizeof(addr);
+                struct stat st;
+
+                if (::getsockname(l.fd, reinterpret_cast<struct sockaddr*>(&addr), &len) == 0)
+                    l.port = ::ntohs(reinterpret_cast<struct sockaddr_in*>(&addr)->sin_port); // same offset for sockaddr_in6
+
+                if (::fstat(l.fd, &st) == 0)
+                    l.inode = st.st_ino;
+
+                listeners_.push_back(l);
+            }
+
+            filter();
+        }
+
+        //! Re-queries the kernel
+        //! @return    false on netlink error, results are then partial
+        bool refresh() {
+
+            for (std::size_t i = 0; i != listeners_.size(); ++i)
+            {
+                listener_diag& l = listeners_[i];
+                l.queued = l.backlog = 0;
+                l.conns = 0;
+                l.rxqueue = histogram();
+                l.txqueue = histogram();
+            }
+
+            bool ok = true;
+
+            // Connection states that can hold queued data
+            const std::uint32_t conns = ((1 << (TCP_CLOSING + 1)) - 1)
+                                        & ~(1 << TCP_LISTEN | 1 << TCP_TIME_WAIT | 1 << TCP_CLOSE);
+
+            const int families[] = { AF_INET, AF_INET6 };
+            for (int f = 0; f != 2; ++f)
+            {
+                ok &= dump(families[f], 1 << TCP_LISTEN);
+                ok &= dump(families[f], conns);
+            }
+
+            read_netstat();
+            return ok;
+        }
+
+        //! Number of listeners
+        std::size_t size() const {
+            return listeners_.size();
+        }
+
+        //! Listener results
+        //! @param i    listener index
+        const listener_diag& listener(const std::size_t i) const {
+            return listeners_[i];
+        }
+
+        //! System-wide TcpExt ListenOverflows, SYNs dropped on a full accept queue
+        std::uint64_t overflows() const {
+            return overflows_;
+        }
+
+        //! System-wide TcpExt ListenDrops
+        std::uint64_t drops() const {
+            return drops_;
+        }
+
+    private:
+
+        static const int DIAG_BUFF_SIZE = 1 << 16;
+
+        // Netlink socket
+        int nlfd_;
+        // Receive buffer
+        std::vector<char> buff_;
+
+        std::vector<listener_diag> listeners_;
+        std::uint64_t overflows_, drops_;
+
+        // Dump request: header, inet_diag_req_v2 and the port filter, built once
+        std::vector<char> req_;
+
+        /*! Builds the dump request, with INET_DIAG_REQ_BYTECODE matching a source port of any listener.
+         *  As ss builds an or: one block per port, an S_GE and an S_LE comparison (S_EQ needs 4.16)
+         *  whose failure jumps to the next block, and past the end (rejected) after the last one; a
+         *  block that matches reaches a JMP to the end (accepted). The kernel only accepts jumps onto
+         *  the chain of "yes" branches, which the JMP continues into the next block.
+         */
+        void filter() {
+
+            std::vector<std::uint16_t> ports;
+            for (std::size_t i = 0; i != listeners_.size(); ++i)
+            {
+                const std::uint16_t port = listeners_[i].port;
+                if (port && std::find(ports.begin(), ports.end(), port) == ports.end())
+                    ports.push_back(port);
+            }
+
+            typedef struct inet_diag_bc_op bc_op;
+
+            // Block of two comparisons, each followed by its port, and the JMP between blocks
+            const std::size_t blocklen = 4 * sizeof(bc_op) + sizeof(bc_op);
+            const std::size_t bclen = ports.empty() ? 0 : ports.size() * blocklen - sizeof(bc_op);
+            const std::size_t attrlen = bclen ? NLA_HDRLEN + bclen : 0;
+            const std::size_t head = NLMSG_LENGTH(sizeof(struct inet_diag_req_v2));
+
+            req_.assign(head + NLA_ALIGN(attrlen), 0);
+
+            struct nlmsghdr* const nlh = reinterpret_cast<struct nlmsghdr*>(req_.data());
+            nlh->nlmsg_len = static_cast<std::uint32_t>(req_.size());
+            nlh->nlmsg_type = SOCK_DIAG_BY_FAMILY;
+            nlh->nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+
+            struct inet_diag_req_v2* const req = static_cast<struct inet_diag_req_v2*>(NLMSG_DATA(nlh));
+            req->sdiag_protocol = IPPROTO_TCP;
+
+            // No known port, dump everything
+            if (bclen == 0)
+                return;
+
+            struct nlattr* const attr = reinterpret_cast<struct nlattr*>(req_.data() + head);
+            attr->nla_len = static_cast<std::uint16_t>(attrlen);
+            attr->nla_type = INET_DIAG_REQ_BYTECODE;
+
+            bc_op* const ops = reinterpret_cast<bc_op*>(reinterpret_cast<char*>(attr) + NLA_HDRLEN);
+
+            for (std::size_t i = 0; i != ports.size(); ++i)
+            {
+                bc_op* const op = ops + 5 * i;
+
+                // Jumps are relative to the op, failures land on the next block
+                op[0].code = INET_DIAG_BC_S_GE;
+                op[0].yes = 2 * sizeof(bc_op);
+                op[0].no = blocklen;
+                op[1].no = ports[i];
+
+                op[2].code = INET_DIAG_BC_S_LE;
+                op[2].yes = 2 * sizeof(bc_op);
+                op[2].no = blocklen - 2 * sizeof(bc_op);
+                op[3].no = ports[i];
+
+                if (i + 1 != ports.size())
+                {
+                    op[4].code = INET_DIAG_BC_JMP;
+                    op[4].yes = sizeof(bc_op);
+                    op[4].no = static_cast<unsigned short>(bclen - (i * blocklen + 4 * sizeof(bc_op)));
+                }
+            }
+        }
+
+        /*! Dumps sockets of one family in the given states and accounts them to listeners
+         */
+        bool dump(const int family, const std::uint32_t states) {
+
+            struct inet_diag_req_v2* const req = static_cast<struct inet_diag_req_v2*>(NLMSG_DATA(reinterpret_cast<struct nlmsghdr*>(req_.data())));
+            req->sdiag_family = static_cast<std::uint8_t>(family);
+            req->idiag_states = states;
+
+            struct sockaddr_nl nladdr = {  };
+            nladdr.nl_family = AF_NETLINK;
+
+            if (::sendto(nlfd_, req_.data(), req_.size(), 0, reinterpret_cast<struct sockaddr*>(&nladdr), sizeof(nladdr)) == -1)
+                return false;
+
+            while (true)
+            {
+                const int n = ::recv(nlfd_, buff_.data(), buff_.size(), 0);
+                if (n <= 0)
+                    return false;
+
+                int len = n;
+                for (struct nlmsghdr* h = reinterpret_cast<struct nlmsghdr*>(buff_.data());
+                     NLMSG_OK(h, len);
+                     h = NLMSG_NEXT(h, len))
+                {
+                    if (h->nlmsg_type == NLMSG_DONE)
+                        return true;
+
+                    if (h->nlmsg_type == NLMSG_ERROR)
+                        return false;
+
+                    account(static_cast<const struct inet_diag_msg*>(NLMSG_DATA(h)));
+                }
+            }
+        }
+
+        /*! Accounts one socket
+         */
+        void account(const struct inet_diag_msg* const m) {
+
+            const std::uint16_t port = ::ntohs(m->id.idiag_sport);
+
+            for (std::size_t i = 0; i != listeners_.size(); ++i)
+            {
+                listener_diag& l = listeners_[i];
+
+                if (m->idiag_state == TCP_LISTEN)
+                {
+                    // For listeners, rqueue is the accept queue length and wqueue its limit
+                    if (m->idiag_inode == l.inode)
+                    {
+                        l.queued = m->idiag_rqueue;
+                        l.backlog = m->idiag_wqueue;
+                        return;
+                    }
+                }
+
+                else if (port == l.port)
+                {
+                    ++l.conns;
+                    l.rxqueue.add(m->idiag_rqueue);
+                    l.txqueue.add(m->idiag_wqueue);
+                    return;
+                }
+            }
+        }
+
+        /*! Reads TcpExt ListenOverflows and ListenDrops from /proc/net/netstat
+         */
+        void read_netstat() {
+
+            char text[8192];
+
+            const int fd = ::open("/proc/net/netstat", O_RDONLY | O_CLOEXEC);
+            if (fd == -1)
+                return;
+
+            const int n = ::read(fd, text, sizeof(text) - 1);
+            ::close(fd);
+
+            if (n <= 0)
+                return;
+
+            text[n] = '\0';
+
+            // Two "TcpExt:" lines, field names followed by values
+            char* const names = std::strstr(text, "TcpExt:");
+            char* const values = names ? std::strstr(names + 1, "TcpExt:") : nullptr;
+            if (values == nullptr)
+                return;
+
+            char* name = names + 7;
+            char* value = values + 7;
+
+            while (*name != '\n' && *name && *value != '\n' && *value)
+            {
+                while (*name == ' ') ++name;
+                while (*value == ' ') ++value;
+
+                const char* const end = name + std::strcspn(name, " \n");
+                const std::size_t len = end - name;
+
+                char* next;
+                const std::uint64_t v = std::strtoull(value, &next, 10);
+
+                if (len == 15 && std::strncmp(name, "ListenOverflows", len) == 0)
+                    overflows_ = v;
+                else if (len == 11 && std::strncmp(name, "ListenDrops", len) == 0)
+                    drops_ = v;
+
+                name = const_cast<char*>(end);
+                value = next;
+            }
+        }
+
+        // Non-copyable object
+        explicit sock_diag(sock_diag&) = delete;
+        explicit sock_diag(const sock_diag&) = delete;
+    };
+}
+
+#endif
@@ -4,9 +4,15 @@
 #ifndef _COMM_ENDPOINT_HPP
 #define _COMM_ENDPOINT_HPP
 
+#include <ctime>
+
 #include <fcntl.h>
 
 #include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 
 namespace comm {
 
@@ -84,6 +90,49 @@ namespace comm {
         return ::recv(sfd, buff, bufflen, 0);
     }
 
+    inline int endpoint_readv(const int sfd,
+                              const struct iovec* const iov,
+                              const int iovcnt)
+    {
+        return ::readv(sfd, iov, iovcnt);
+    }
+
+    inline int endpoint_readv(const int sfd,
+                              const struct iovec* const iov,
+                              const int iovcnt,
+                              struct timespec* const ts)
+    {
+        char control[CMSG_SPACE(sizeof(struct scm_timestamping))];
+
+        struct msghdr msg = {  };
+        msg.msg_iov = const_cast<struct iovec*>(iov);
+        msg.msg_iovlen = iovcnt;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        const int ret = ::recvmsg(sfd, &msg, 0);
+
+        // The control buffer is only filled in by a successful read
+        ts->tv_sec = ts->tv_nsec = 0;
+        for (struct cmsghdr* cmsg = ret > 0 ? CMSG_FIRSTHDR(&msg) : nullptr; cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg))
+        {
+            if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPING)
+            {
+                // Software timestamp is the first of three
+                *ts = reinterpret_cast<struct scm_timestamping*>(CMSG_DATA(cmsg))->ts[0];
+                break;
+            }
+        }
+
+        return ret;
+    }
+
+    inline int endpoint_rx_timestamps(const int sfd)
+    {
+        int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+        return setsockopt(sfd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(int));
+    }
+
     inline int endpoint_read_oob(const int sfd,
                                  void* const buff)
     {
@@ -159,6 +208,24 @@ namespace comm {
         return ::close(sfd);
     }
 
+    inline int endpoint_linger_reset(const int sfd)
+    {
+        struct linger lg = { 1, 0 };
+        return ::setsockopt(sfd, SOL_SOCKET, SO_LINGER, &lg, sizeof(struct linger));
+    }
+
+    inline int endpoint_shutdown_read(const int sfd)
+    {
+        return ::shutdown(sfd, SHUT_RD);
+    }
+
+    inline int endpoint_tcp_info(const int sfd,
+                                 struct tcp_info* const info)
+    {
+        socklen_t size = sizeof(struct tcp_info);
+        return ::getsockopt(sfd, IPPROTO_TCP, TCP_INFO, info, &size);
+    }
+
     inline int endpoint_accept(const int sfd)
     {
         struct sockaddr_in addr = {};
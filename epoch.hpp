@@ -0,0 +1,165 @@
+/* epoch.hpp -- v1.0 -- quiescent-state epochs for deferred reuse of shared objects
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_EPOCH_HPP
+#define _COMM_EPOCH_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+namespace comm {
+
+    // Reader slots for threads other than the pool's workers, see epoch_guard
+    static const std::size_t MAX_EPOCH_READERS = 16;
+
+    //! @class epoch_domain
+    /*! global epoch plus the epoch each participant last announced. Workers announce at quiescent points,
+     *  where they hold no references (between epoll batches); other threads announce for the duration of
+     *  an epoch_guard. An object retired at epoch E may be reused once every participant has announced a
+     *  later epoch, so readers never block or write shared state.
+     */
+    class epoch_domain {
+    public:
+
+        // Announced by participants that aren't reading
+        static const std::uint64_t OFFLINE = ~static_cast<std::uint64_t>(0);
+
+        //! dtor.
+        //!
+        ~epoch_domain() {
+            std::free(slots_);
+        }
+
+        //! ctor.
+        //! @param nworkers    worker participants, ids 0 to nworkers - 1
+        explicit epoch_domain(const std::size_t nworkers) : global_(1)
+                                                          , nworkers_(nworkers)
+                                                          , slots_(static_cast<slot*>(::aligned_alloc(64, (nworkers + MAX_EPOCH_READERS) * sizeof(slot)))) {
+
+            if (slots_ == nullptr)
+                throw std::bad_alloc();
+
+            for (std::size_t i = 0; i != nworkers_ + MAX_EPOCH_READERS; ++i)
+                new (&slots_[i]) slot(OFFLINE);
+        }
+
+        //! Announces that a worker holds no references
+        //! @param id    worker index
+        void quiesce(const std::size_t id) {
+            slots_[id].seen.store(global_.load(std::memory_order_acquire), std::memory_order_release);
+        }
+
+        //! Marks a worker as not reading, e.g. when it exits
+        //! @param id    worker index
+        void offline(const std::size_t id) {
+            slots_[id].seen.store(OFFLINE, std::memory_order_release);
+        }
+
+        //! Advances the epoch after an object was unlinked
+        //! @return    epoch to tag the object with
+        std::uint64_t retire() {
+            return global_.fetch_add(1, std::memory_order_seq_cst);
+        }
+
+        //! Checks whether every participant has passed a quiescent point since an object was retired
+        //! @param epoch    value returned by retire()
+        bool reclaimable(const std::uint64_t epoch) const {
+
+            for (std::size_t i = 0; i != nworkers_ + MAX_EPOCH_READERS; ++i)
+            {
+                if (slots_[i].seen.load(std::memory_order_acquire) <= epoch)
+                    return false;
+            }
+
+            return true;
+        }
+
+    private:
+
+        friend class epoch_guard;
+
+        /*! @struct slot
+         *  announced epoch, one cache line per participant
+         */
+        struct alignas(64) slot {
+            std::atomic<std::uint64_t> seen;
+            explicit slot(const std::uint64_t e) : seen(e) {  }
+        };
+
+        std::atomic<std::uint64_t> global_;
+
+        std::size_t nworkers_;
+        slot* slots_;
+
+        /*! Takes a reader slot and announces the current epoch; waits while all are taken
+         */
+        std::size_t pin() {
+
+            while (true)
+            {
+                for (std::size_t i = nworkers_; i != nworkers_ + MAX_EPOCH_READERS; ++i)
+                {
+                    std::uint64_t expected = OFFLINE;
+                    std::uint64_t epoch = global_.load(std::memory_order_seq_cst);
+
+                    if (!slots_[i].seen.compare_exchange_strong(expected, epoch, std::memory_order_seq_cst))
+                        continue;
+
+                    // A retire() racing the announcement may not have seen it, announce its epoch instead
+                    std::uint64_t now;
+                    while ((now = global_.load(std::memory_order_seq_cst)) != epoch)
+                    {
+                        slots_[i].seen.store(now, std::memory_order_seq_cst);
+                        epoch = now;
+                    }
+
+                    return i;
+                }
+
+                std::this_thread::yield();
+            }
+        }
+
+        /*! Impl.
+         */
+        void unpin(const std::size_t i) {
+            slots_[i].seen.store(OFFLINE, std::memory_order_release);
+        }
+
+        // Non-copyable object
+        explicit epoch_domain(epoch_domain&) = delete;
+        explicit epoch_domain(const epoch_domain&) = delete;
+    };
+
+    //! @class epoch_guard
+    /*! keeps objects retired while it lives from being reused, for threads that read a pool's
+     *  connections outside its workers
+     */
+    class epoch_guard {
+    public:
+
+        //! dtor.
+        //!
+        ~epoch_guard() {
+            domain_.unpin(slot_);
+        }
+
+        //! ctor.
+        //! @param domain    e.g. client_pool::epochs()
+        explicit epoch_guard(epoch_domain& domain) : domain_(domain), slot_(domain.pin()) {  }
+
+    private:
+
+        epoch_domain& domain_;
+        std::size_t slot_;
+
+        // Non-copyable object
+        explicit epoch_guard(epoch_guard&) = delete;
+        explicit epoch_guard(const epoch_guard&) = delete;
+    };
+}
+
+#endif
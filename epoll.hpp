@@ -4,10 +4,13 @@
 #ifndef _COMM_EPOLL_HPP
 #define _COMM_EPOLL_HPP
 
+#include <cstring>
+
 #include <sys/epoll.h>
 
-#include "client.hpp"
 #include "endpoint.hpp"
+#include "watcher.hpp"
+#include "worker.hpp"
 
 namespace comm {
 
@@ -38,11 +41,11 @@ namespace comm {
                        const int opcode,
                        const int sfd,
                        const int events,
-                       const int userdata)
+                       const std::uint64_t userdata)
         {
             ::epoll_event epollEvent = {  };
             epollEvent.events = events;
-            epollEvent.data.u32 = userdata;
+            epollEvent.data.u64 = userdata;
 
             const int ret = epoll_ctl(epfd, opcode, sfd, &epollEvent);
             return ret;
@@ -101,37 +104,61 @@ namespace comm {
 
         //! Adds managed server socket
         //! @param sfd    socket file descriptor
+        //! @param id     listener index, returned with the descriptor in the upper 32 bits of the event data
         template <typename Q = Tderiv>
         typename std::enable_if<std::is_base_of<server_pool_base, Q>::value,
-                                int>::type add(int sfd) {
+                                int>::type add(int sfd, const std::uint32_t id = 0) {
             const int events = EPOLLIN | EPOLLET | EPOLLEXCLUSIVE;
-            const int ret = detail::ctl(epfd_, EPOLL_CTL_ADD, sfd, events, sfd);
+            const std::uint64_t data = (static_cast<std::uint64_t>(id) << 32) | static_cast<std::uint32_t>(sfd);
+            const int ret = detail::ctl(epfd_, EPOLL_CTL_ADD, sfd, events, data);
             return ret;
         }
 
         //! Adds managed client descriptor
-        //! @param handler    pointer to client
+        //! @param sfd    socket file descriptor
+        //! @param key    client slot and generation, see connection_table::key()
         template <typename Q = Tderiv>
         typename std::enable_if<std::is_base_of<client_pool_base, Q>::value,
-                                int>::type add(client* handler) {
+                                int>::type add(const int sfd, const std::uint64_t key) {
             const int events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLPRI | EPOLLONESHOT;
-            const int ret = detail::ctl(epfd_, EPOLL_CTL_ADD, handler->sfd, events, handler);
+            const int ret = detail::ctl(epfd_, EPOLL_CTL_ADD, sfd, events, key);
             return ret;
         }
 
         //! Re-adds client descriptor
-        //! @param handler    pointer to client
+        //! @param sfd    socket file descriptor
+        //! @param key    client slot and generation, see connection_table::key()
         template <typename Q = Tderiv>
         typename std::enable_if<std::is_base_of<client_pool_base, Q>::value,
-                                int>::type rearm(client* handler) {
+                                int>::type rearm(const int sfd, const std::uint64_t key) {
             const int events = EPOLLIN | EPOLLET | EPOLLRDHUP | EPOLLPRI | EPOLLONESHOT;
-            const int ret = detail::ctl(epfd_, EPOLL_CTL_MOD, handler->sfd, events, handler);
+            const int ret = detail::ctl(epfd_, EPOLL_CTL_MOD, sfd, events, key);
             return ret;
         }
 
+        //! Watches an auxiliary descriptor, dispatched by the workers of this instance along with its
+        //! own events (see watcher.hpp); the watcher must outlive its registration
+        //! @param w         watcher
+        //! @param events    epoll events, level-triggered
+        int watch(fd_watcher* const w, const std::uint32_t events = EPOLLIN) {
+            w->unwatched_.store(false, std::memory_order_relaxed);
+            return detail::ctl(epfd_, EPOLL_CTL_ADD, w->fd(), events | EPOLLONESHOT, WATCHER_TAG | key(w, events));
+        }
+
+        //! Stops watching a descriptor, also from the watcher's own callback. The callback may still be
+        //! running on a worker, so free the watcher (and close its descriptor) only once the instance
+        //! has stopped
+        //! @param w    watcher
+        int unwatch(fd_watcher* const w) {
+            w->unwatched_.store(true, std::memory_order_release);
+
+            struct epoll_event event = {  };
+            return epoll_ctl(epfd_, EPOLL_CTL_DEL, w->fd(), &event);
+        }
+
         //! Waits on epoll instance
-        //!
-        inline void wait();
+        //! @param w    calling thread's context
+        inline void wait(worker& w);
 
         //! Signals shut down by writing to pipe
         //!
@@ -144,11 +171,37 @@ namespace comm {
 
         static const int DEFAULT_MAX_EVENTS = 65536;
 
+        // Interval between getrusage() samples, nsec
+        static const std::uint64_t USAGE_INTERVAL = 100000000;
+        // Interval between copies of a worker's counters to its stats slot, nsec
+        static const std::uint64_t PUBLISH_INTERVAL = 10000000;
+
         // Pipe used to send control signals; signals close
         int selfpipe_[2];
         // Epoll parameters
         int epfd_, maxevents_;
 
+        /*! Watcher event data: the pointer, with the requested events in the upper bits it leaves
+         *  free (user-space addresses fit in 48 bits), so re-arming needs nothing from the watcher
+         */
+        static std::uint64_t key(const fd_watcher* const w, const std::uint32_t events) {
+            const std::uint64_t mask = EPOLLIN | EPOLLPRI | EPOLLOUT | EPOLLRDHUP;
+            return reinterpret_cast<std::uintptr_t>(w) | ((events & mask) << 48);
+        }
+
+        /*! Dispatches a watcher event and re-arms it
+         */
+        void dispatch(const std::uint64_t data, const std::uint32_t events) {
+
+            fd_watcher* const w = reinterpret_cast<fd_watcher*>(static_cast<std::uintptr_t>(data & ((static_cast<std::uint64_t>(1) << 48) - 1)));
+
+            w->dispatch(events);
+
+            // Once unwatched, the descriptor may be closed and its number reused by a client on this instance
+            if (!w->unwatched_.load(std::memory_order_acquire))
+                detail::ctl(epfd_, EPOLL_CTL_MOD, w->fd(), static_cast<int>(((data & ~WATCHER_TAG) >> 48) | EPOLLONESHOT), data);
+        }
+
         // Non-copyable object
         explicit epoll(epoll&) = delete;
         explicit epoll(const epoll&) = delete;
@@ -157,25 +210,88 @@ namespace comm {
     /*! Waits on epoll instance
      */
     template <typename Tderiv>
-    void comm::epoll<Tderiv>::wait()
+    void comm::epoll<Tderiv>::wait(worker& w)
     {
         const int epfd = epfd_;
         const int maxevents = maxevents_;
 
+        // Events ahead of the one being processed whose state the derived pool prefetches
+        const int ahead = static_cast<Tderiv*>(this)->prefetch_distance();
+
         epoll_event* const events = new epoll_event[maxevents];
 
+        detail::current_worker() = &w;
+
+        // Counters are accumulated privately and published under the slot's seqlock, so readers never
+        // wait on a batch; carried over from an earlier run
+        worker_stats& st = w.counters;
+        std::memcpy(&st, &w.stats->data, sizeof(worker_stats));
+
+        // Time spent in epoll_wait() since the last flush, and of the last CPU usage sample and publish
+        std::uint64_t t0 = detail::now(), idle = 0, sampled = 0, published = t0;
+
         while (true)
         {
+            // No references from the last batch are held past this point
+            static_cast<Tderiv*>(this)->quiesce(w);
+
             int nevents;
             if ((nevents = epoll_wait(epfd, events, maxevents, 0)) == -1) {
                 break; // Encountered error
             }
 
+            const std::uint64_t t1 = detail::now();
+            idle += t1 - t0;
+            t0 = t1;
+
+            const bool sample = t1 - sampled >= USAGE_INTERVAL;
+            if (nevents == 0 && !sample)
+                continue;
+
+            st.wait_ns += idle;
+            idle = 0;
+
+            if (sample)
+            {
+                detail::sample_usage(st);
+                sampled = t1;
+
+                // Periodic upkeep of the derived pool
+                static_cast<Tderiv*>(this)->maintain(w);
+            }
+
+            if (nevents)
+            {
+                ++st.loops;
+                st.events += nevents;
+                st.batch.add(nevents);
+            }
+
+            if (nevents)
+                static_cast<Tderiv*>(this)->loop_begin(w, nevents);
+
+            // Prefetches in two stages: the pool's own state first, then memory it points to once that
+            // has arrived, half the distance later
+            for (int i = 0; i < ahead && i < nevents; ++i)
+                static_cast<Tderiv*>(this)->prefetch(events[i].data, 0);
+            for (int i = 0; i < ahead / 2 && i < nevents; ++i)
+                static_cast<Tderiv*>(this)->prefetch(events[i].data, 1);
+
             for (int i = 0; i != nevents; ++i)
             {
+                if (ahead && i + ahead < nevents)
+                    static_cast<Tderiv*>(this)->prefetch(events[i + ahead].data, 0);
+                if (i + ahead / 2 < nevents && ahead > 1)
+                    static_cast<Tderiv*>(this)->prefetch(events[i + ahead / 2].data, 1);
+
                 // If have a control socket, process message
                 if (events[i].data.ptr == nullptr)
                 {
+                    static_cast<Tderiv*>(this)->loop_end(w);
+
+                    stats_publish(w.stats, st);
+                    detail::current_worker() = nullptr;
+
                     delete[] events;
 
                     char ch;
@@ -198,14 +314,39 @@ namespace comm {
                     return;
                 }
 
+                // Auxiliary descriptor, see watch()
+                else if (events[i].data.u64 & WATCHER_TAG)
+                {
+                    dispatch(events[i].data.u64, events[i].events);
+                    w.scratch.reset();
+                }
+
                 // Otherwise, have a regular socket, so handle the event
                 else
                 {
                     static_cast<Tderiv*>(this)->process(static_cast<Tderiv*>(this)->cast(events[i].data),
                                                         events[i].events);
+                    w.scratch.reset();
                 }
             }
+
+            if (nevents)
+                static_cast<Tderiv*>(this)->loop_end(w);
+
+            t0 = detail::now();
+            st.dispatch_ns += t0 - t1;
+
+            if (t0 - published >= PUBLISH_INTERVAL)
+            {
+                stats_publish(w.stats, st);
+                published = t0;
+            }
         }
+
+        stats_publish(w.stats, st);
+
+        detail::current_worker() = nullptr;
+        delete[] events;
     }
 }
 
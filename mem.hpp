@@ -9,6 +9,8 @@
 
 #include <unistd.h>
 
+#include <linux/mempolicy.h>
+
 #include <sys/mman.h>
 #include <sys/syscall.h>
 
@@ -106,6 +108,133 @@ namespace comm {
     {
         detail::mov_memmap(tgt, src, sizeof(T), size);
     }
+
+    // Allocator policies for client slabs, connection tables and queues. A policy has static
+    //   void* allocate(std::size_t bytes)              zero-filled, page aligned; throws std::runtime_error
+    //   void deallocate(void* p, std::size_t bytes)
+    //   static const bool mirrored                     whether [p + bytes, p + 2 * bytes) maps [p, p + bytes)
+    // and is passed to client_pool (and so to its connection_table and unused queue) or atomic_queue.
+    // Sizes are always a whole number of pages. A user-supplied policy can carve memory out of its own
+    // arena or pool the same way.
+
+    //! @struct mirror_alloc
+    /*! double-mapped memfd, see gen_memmap(); the default
+     */
+    struct mirror_alloc {
+        static const bool mirrored = true;
+
+        static void* allocate(const std::size_t bytes) {
+            std::size_t count = bytes;
+            return detail::gen_memmap(1, &count);
+        }
+
+        static void deallocate(void* const p, const std::size_t bytes) {
+            detail::del_memmap(p, 1, bytes * 2);
+        }
+    };
+
+    //! @struct mmap_alloc
+    /*! private anonymous mapping, no mirror
+     */
+    struct mmap_alloc {
+        static const bool mirrored = false;
+
+        static void* allocate(const std::size_t bytes) {
+
+            void* const p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED)
+                throw std::runtime_error("memory allocation error");
+
+            return p;
+        }
+
+        static void deallocate(void* const p, const std::size_t bytes) {
+            ::munmap(p, bytes);
+        }
+    };
+
+    //! @struct hugepage_alloc
+    /*! 2 MiB pages from the hugetlb pool, falling back to a mapping advised for transparent huge pages
+     *  when the pool is empty; cuts TLB misses on large slabs
+     */
+    struct hugepage_alloc {
+        static const bool mirrored = false;
+        static const std::size_t HUGE_PAGE_SIZE = 2 << 20;
+
+        static void* allocate(const std::size_t bytes) {
+
+            const std::size_t size = round(bytes);
+
+            void* p = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED)
+                return p;
+
+            p = mmap_alloc::allocate(size);
+            ::madvise(p, size, MADV_HUGEPAGE);
+            return p;
+        }
+
+        static void deallocate(void* const p, const std::size_t bytes) {
+            ::munmap(p, round(bytes));
+        }
+
+    private:
+
+        /*! Impl.
+         */
+        static std::size_t round(const std::size_t bytes) {
+            return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+        }
+    };
+
+    //! @struct numa_alloc
+    /*! private anonymous mapping bound to the NUMA node of the allocating thread, so a pool built on
+     *  the node its workers run on keeps its memory there regardless of which thread touches it first.
+     *  Falls back to the default policy where mbind() isn't available.
+     */
+    struct numa_alloc {
+        static const bool mirrored = false;
+
+        static void* allocate(const std::size_t bytes) {
+
+            void* const p = mmap_alloc::allocate(bytes);
+
+            unsigned cpu, node;
+            if (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 && node < 8 * sizeof(unsigned long))
+            {
+                const unsigned long mask = 1UL << node;
+                ::syscall(SYS_mbind, p, bytes, MPOL_PREFERRED, &mask, 8 * sizeof(mask), 0);
+            }
+
+            return p;
+        }
+
+        static void deallocate(void* const p, const std::size_t bytes) {
+            ::munmap(p, bytes);
+        }
+    };
+
+    //! Allocates an array from a policy
+    //! @param[in/out] count    element count, expanded to a multiple of the page size as by gen_memmap()
+    template <typename Talloc, typename T>
+    inline T* alloc_array(std::size_t* const count)
+    {
+        static const std::size_t pagesize = getpagesize();
+
+        if (*count % pagesize)
+            *count = *count + pagesize - (*count % pagesize);
+
+        return static_cast<T*>(Talloc::allocate(*count * sizeof(T)));
+    }
+
+    //! Frees an array from alloc_array()
+    //! @param p        array
+    //! @param count    element count returned by alloc_array()
+    template <typename Talloc, typename T>
+    inline void free_array(T* const p, const std::size_t count)
+    {
+        Talloc::deallocate(p, count * sizeof(T));
+    }
 }
 
 #endif
@@ -0,0 +1,426 @@
+/* metrics.hpp -- v1.0 -- prometheus text exposition of pool counters, served from a dedicated pool
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_METRICS_HPP
+#define _COMM_METRICS_HPP
+
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <poll.h>
+
+#include "diag.hpp"
+#include "pool.hpp"
+
+namespace comm {
+
+    static const int MAX_METRICS_SIZE = 1 << 20;
+
+    // Time a scrape may wait for a slow reader to drain the response, msec
+    static const int METRICS_WRITE_TIMEOUT = 1000;
+
+    namespace detail {
+        /*! Appends formatted text to a fixed buffer, never allocates
+         */
+        struct metrics_writer {
+
+            char* buff;
+            std::size_t cap, len;
+            bool overflow;
+
+            metrics_writer(char* b, const std::size_t c) : buff(b), cap(c), len(0), overflow(false) {  }
+
+            void print(const char* fmt, ...) __attribute__((format(printf, 2, 3))) {
+
+                if (overflow)
+                    return;
+
+                va_list args;
+                va_start(args, fmt);
+                const int n = std::vsnprintf(buff + len, cap - len, fmt, args);
+                va_end(args);
+
+                if (n < 0 || static_cast<std::size_t>(n) >= cap - len)
+                    overflow = true;
+                else
+                    len += n;
+            }
+        };
+
+        /*! Impl.
+         */
+        inline const char* role_name(const std::uint32_t role) {
+            return role == STATS_LISTENER ? "listener" : "worker";
+        }
+
+        /*! Renders one counter family, one sample per slot
+         */
+        inline void render_counter(metrics_writer& out,
+                                   const stats_segment& seg,
+                                   const worker_stats* const snap,
+                                   const char* name,
+                                   const char* help,
+                                   std::uint64_t worker_stats::* field)
+        {
+            out.print("# HELP comm_%s %s\n# TYPE comm_%s counter\n", name, help, name);
+
+            for (std::size_t i = 0; i != seg.size(); ++i)
+            {
+                out.print("comm_%s{slot=\"%zu\",role=\"%s\"} %llu\n",
+                          name, i, role_name(seg.slots()[i].role),
+                          static_cast<unsigned long long>(snap[i].*field));
+            }
+        }
+
+        /*! Renders one histogram family, one histogram per slot
+         */
+        inline void render_histogram(metrics_writer& out,
+                                     const stats_segment& seg,
+                                     const worker_stats* const snap,
+                                     const char* name,
+                                     const char* help,
+                                     histogram worker_stats::* field)
+        {
+            out.print("# HELP comm_%s %s\n# TYPE comm_%s histogram\n", name, help, name);
+
+            for (std::size_t i = 0; i != seg.size(); ++i)
+            {
+                const histogram& h = snap[i].*field;
+                const char* const role = role_name(seg.slots()[i].role);
+
+                std::uint64_t count = 0;
+                for (int b = 0; b != HISTOGRAM_BUCKETS - 1; ++b)
+                {
+                    count += h.bucket[b];
+                    out.print("comm_%s_bucket{slot=\"%zu\",role=\"%s\",le=\"%llu\"} %llu\n",
+                              name, i, role,
+                              static_cast<unsigned long long>(histogram::upper(b)),
+                              static_cast<unsigned long long>(count));
+                }
+
+                count += h.bucket[HISTOGRAM_BUCKETS - 1];
+                out.print("comm_%s_bucket{slot=\"%zu\",role=\"%s\",le=\"+Inf\"} %llu\n"
+                          "comm_%s_sum{slot=\"%zu\",role=\"%s\"} %llu\n"
+                          "comm_%s_count{slot=\"%zu\",role=\"%s\"} %llu\n",
+                          name, i, role, static_cast<unsigned long long>(count),
+                          name, i, role, static_cast<unsigned long long>(h.sum),
+                          name, i, role, static_cast<unsigned long long>(count));
+            }
+        }
+
+        /*! Renders one TCP_INFO histogram family, summed over slots, one histogram per listener
+         */
+        inline void render_tcp_histogram(metrics_writer& out,
+                                         const stats_segment& seg,
+                                         const worker_stats* const snap,
+                                         const char* name,
+                                         const char* help,
+                                         histogram tcp_stats::* field)
+        {
+            out.print("# HELP comm_tcp_%s %s\n# TYPE comm_tcp_%s histogram\n", name, help, name);
+
+            for (int l = 0; l != MAX_LISTENERS; ++l)
+            {
+                histogram h = {  };
+                for (std::size_t i = 0; i != seg.size(); ++i)
+                {
+                    const histogram& src = snap[i].tcp[l].*field;
+                    for (int b = 0; b != HISTOGRAM_BUCKETS; ++b)
+                        h.bucket[b] += src.bucket[b];
+                    h.sum += src.sum;
+                }
+
+                const std::uint64_t total = h.count();
+                if (total == 0)
+                    continue; // Listener unused or not sampled
+
+                std::uint64_t count = 0;
+                for (int b = 0; b != HISTOGRAM_BUCKETS - 1; ++b)
+                {
+                    count += h.bucket[b];
+                    out.print("comm_tcp_%s_bucket{listener=\"%d\",le=\"%llu\"} %llu\n",
+                              name, l,
+                              static_cast<unsigned long long>(histogram::upper(b)),
+                              static_cast<unsigned long long>(count));
+                }
+
+                out.print("comm_tcp_%s_bucket{listener=\"%d\",le=\"+Inf\"} %llu\n"
+                          "comm_tcp_%s_sum{listener=\"%d\"} %llu\n"
+                          "comm_tcp_%s_count{listener=\"%d\"} %llu\n",
+                          name, l, static_cast<unsigned long long>(total),
+                          name, l, static_cast<unsigned long long>(h.sum),
+                          name, l, static_cast<unsigned long long>(total));
+            }
+        }
+    }
+
+    //! Renders a stats segment in prometheus text format
+    //! Slots are read through their seqlock, writers are never blocked; a slot that can't be read
+    //! consistently keeps its previous snapshot and is counted in comm_stats_stale_slots
+    //! @param seg        stats segment
+    //! @param snap       seg.size() snapshots, zeroed before the first call and refreshed by each
+    //! @param buff       output buffer
+    //! @param bufflen    output buffer length
+    //! @return           rendered length, 0 if the buffer is too small
+    inline std::size_t render_metrics(const stats_segment& seg,
+                                      worker_stats* const snap,
+                                      char* const buff,
+                                      const std::size_t bufflen)
+    {
+        // A torn copy would show counters going backwards, so only consistent ones replace a snapshot
+        worker_stats fresh;
+
+        std::uint64_t stale = 0;
+        for (std::size_t i = 0; i != seg.size(); ++i)
+        {
+            if (stats_read(&seg.slots()[i], &fresh))
+                std::memcpy(&snap[i], &fresh, sizeof(worker_stats));
+            else
+                ++stale;
+        }
+
+        detail::metrics_writer out(buff, bufflen);
+
+        out.print("# HELP comm_clients Client slots in use\n# TYPE comm_clients gauge\ncomm_clients %llu\n"
+                  "# HELP comm_client_capacity Client slot capacity\n# TYPE comm_client_capacity gauge\ncomm_client_capacity %llu\n",
+                  static_cast<unsigned long long>(seg.header()->clients.load(std::memory_order_relaxed)),
+                  static_cast<unsigned long long>(seg.header()->clientcap));
+
+        out.print("# HELP comm_stats_stale_slots Slots whose counters were busy and are from an earlier scrape\n"
+                  "# TYPE comm_stats_stale_slots gauge\ncomm_stats_stale_slots %llu\n",
+                  static_cast<unsigned long long>(stale));
+
+        detail::render_counter(out, seg, snap, "loops_total", "epoll_wait() calls that returned events", &worker_stats::loops);
+        detail::render_counter(out, seg, snap, "events_total", "Events dispatched", &worker_stats::events);
+        detail::render_counter(out, seg, snap, "accepts_total", "Connections accepted", &worker_stats::accepts);
+        detail::render_counter(out, seg, snap, "rejects_total", "Connections dropped at capacity", &worker_stats::rejects);
+        detail::render_counter(out, seg, snap, "opens_total", "Connections added to the client pool", &worker_stats::opens);
+        detail::render_counter(out, seg, snap, "closes_total", "Connections closed", &worker_stats::closes);
+        detail::render_counter(out, seg, snap, "resets_total", "Connections closed with RST", &worker_stats::resets);
+        detail::render_counter(out, seg, snap, "close_errors_total", "Batched socket closes that completed with an error", &worker_stats::close_errors);
+        detail::render_counter(out, seg, snap, "reads_total", "Successful reads", &worker_stats::reads);
+        detail::render_counter(out, seg, snap, "read_bytes_total", "Bytes read", &worker_stats::bytes_in);
+        detail::render_counter(out, seg, snap, "parks_total", "Idle connections whose receive buffers were released", &worker_stats::parks);
+        detail::render_counter(out, seg, snap, "wait_nsec_total", "Wall time inside epoll_wait()", &worker_stats::wait_ns);
+        detail::render_counter(out, seg, snap, "dispatch_nsec_total", "Wall time processing events", &worker_stats::dispatch_ns);
+        detail::render_counter(out, seg, snap, "cpu_user_usec_total", "Thread user CPU time", &worker_stats::user_us);
+        detail::render_counter(out, seg, snap, "cpu_sys_usec_total", "Thread system CPU time", &worker_stats::sys_us);
+        detail::render_counter(out, seg, snap, "voluntary_switches_total", "Voluntary context switches", &worker_stats::vcsw);
+        detail::render_counter(out, seg, snap, "involuntary_switches_total", "Involuntary context switches", &worker_stats::ivcsw);
+
+        detail::render_histogram(out, seg, snap, "batch_events", "Events per epoll_wait()", &worker_stats::batch);
+        detail::render_histogram(out, seg, snap, "read_bytes", "Bytes per read", &worker_stats::readsize);
+        detail::render_histogram(out, seg, snap, "rx_delay_nsec", "Kernel receive timestamp to read", &worker_stats::rxdelay);
+
+        detail::render_tcp_histogram(out, seg, snap, "rtt_usec", "Sampled smoothed RTT", &tcp_stats::rtt);
+        detail::render_tcp_histogram(out, seg, snap, "retrans_segments", "Sampled retransmits since the previous sample", &tcp_stats::retrans);
+        detail::render_tcp_histogram(out, seg, snap, "cwnd_segments", "Sampled congestion window", &tcp_stats::cwnd);
+        detail::render_tcp_histogram(out, seg, snap, "unacked_bytes", "Sampled unacknowledged bytes in flight (segments times MSS)", &tcp_stats::unacked);
+
+        out.print("# HELP comm_tcp_flagged_total Samples reported to on_retransmit()\n# TYPE comm_tcp_flagged_total counter\n");
+        for (int l = 0; l != MAX_LISTENERS; ++l)
+        {
+            std::uint64_t flagged = 0;
+            for (std::size_t i = 0; i != seg.size(); ++i)
+                flagged += snap[i].tcp[l].flagged;
+
+            if (flagged)
+                out.print("comm_tcp_flagged_total{listener=\"%d\"} %llu\n", l, static_cast<unsigned long long>(flagged));
+        }
+
+        return out.overflow ? 0 : out.len;
+    }
+
+    //! Renders sock_diag results in prometheus text format
+    //! @param diag       refreshed monitor
+    //! @param buff       output buffer
+    //! @param bufflen    output buffer length
+    //! @return           rendered length, 0 if the buffer is too small
+    inline std::size_t render_diag(const sock_diag& diag,
+                                   char* const buff,
+                                   const std::size_t bufflen)
+    {
+        detail::metrics_writer out(buff, bufflen);
+
+        out.print("# HELP comm_listen_queue Connections waiting in the accept queue\n# TYPE comm_listen_queue gauge\n");
+        for (std::size_t i = 0; i != diag.size(); ++i)
+            out.print("comm_listen_queue{listener=\"%zu\",port=\"%u\"} %u\n", i, diag.listener(i).port, diag.listener(i).queued);
+
+        out.print("# HELP comm_listen_backlog Accept queue limit\n# TYPE comm_listen_backlog gauge\n");
+        for (std::size_t i = 0; i != diag.size(); ++i)
+            out.print("comm_listen_backlog{listener=\"%zu\",port=\"%u\"} %u\n", i, diag.listener(i).port, diag.listener(i).backlog);
+
+        out.print("# HELP comm_kernel_connections Kernel sockets on the listener's port\n# TYPE comm_kernel_connections gauge\n");
+        for (std::size_t i = 0; i != diag.size(); ++i)
+        {
+            out.print("comm_kernel_connections{listener=\"%zu\",port=\"%u\"} %llu\n", i, diag.listener(i).port,
+                      static_cast<unsigned long long>(diag.listener(i).conns));
+        }
+
+        const char* const names[] = { "rx_queue_bytes", "tx_queue_bytes" };
+        const char* const helps[] = { "Unread bytes per connection", "Unsent or unacknowledged bytes per connection" };
+        histogram listener_diag::* const fields[] = { &listener_diag::rxqueue, &listener_diag::txqueue };
+
+        for (int f = 0; f != 2; ++f)
+        {
+            out.print("# HELP comm_%s %s\n# TYPE comm_%s histogram\n", names[f], helps[f], names[f]);
+
+            for (std::size_t i = 0; i != diag.size(); ++i)
+            {
+                const histogram& h = diag.listener(i).*fields[f];
+
+                std::uint64_t count = 0;
+                for (int b = 0; b != HISTOGRAM_BUCKETS - 1; ++b)
+                {
+                    count += h.bucket[b];
+                    out.print("comm_%s_bucket{listener=\"%zu\",le=\"%llu\"} %llu\n", names[f], i,
+                              static_cast<unsigned long long>(histogram::upper(b)),
+                              static_cast<unsigned long long>(count));
+                }
+
+                count += h.bucket[HISTOGRAM_BUCKETS - 1];
+                out.print("comm_%s_bucket{listener=\"%zu\",le=\"+Inf\"} %llu\n"
+                          "comm_%s_sum{listener=\"%zu\"} %llu\n"
+                          "comm_%s_count{listener=\"%zu\"} %llu\n",
+                          names[f], i, static_cast<unsigned long long>(count),
+                          names[f], i, static_cast<unsigned long long>(h.sum),
+                          names[f], i, static_cast<unsigned long long>(count));
+            }
+        }
+
+        out.print("# HELP comm_listen_overflows_total SYNs dropped on a full accept queue, system-wide\n"
+                  "# TYPE comm_listen_overflows_total counter\ncomm_listen_overflows_total %llu\n"
+                  "# HELP comm_listen_drops_total Connection requests dropped by listeners, system-wide\n"
+                  "# TYPE comm_listen_drops_total counter\ncomm_listen_drops_total %llu\n",
+                  static_cast<unsigned long long>(diag.overflows()),
+                  static_cast<unsigned long long>(diag.drops()));
+
+        return out.overflow ? 0 : out.len;
+    }
+
+    //! @class metrics_handler
+    /*! client handler answering any HTTP GET with the metrics of a stats segment
+     *  Meant to run in its own small server, e.g. comm::server<comm::metrics_handler> admin(1, 16, sv->stats());
+     */
+    class metrics_handler : public client_pool<metrics_handler> {
+    public:
+
+        //! ctor.
+        //! @param nworkers     client handler thread count
+        //! @param clientcap    maximum number of clients
+        //! @param source       counters to expose
+        //! @param diag         optional kernel queue monitor, refreshed on each scrape
+        metrics_handler(const std::size_t nworkers,
+                        const std::size_t clientcap,
+                        std::shared_ptr<const stats_segment> source,
+                        std::shared_ptr<sock_diag> diag = nullptr) : client_pool<metrics_handler>(nworkers, clientcap)
+                                                                   , source_(source)
+                                                                   , diag_(diag)
+                                                                   , scratch_(nworkers) {
+
+            // Rendering buffers are set up once per admin worker, scrapes don't allocate
+            for (std::size_t i = 0; i != nworkers; ++i)
+            {
+                scratch_[i].body.resize(MAX_METRICS_SIZE);
+                scratch_[i].snap.resize(source_->size());
+            }
+        }
+
+        inline void on_input(int sfd, char* data, int datalen) {
+
+            if (datalen < 4 || std::memcmp(data, "GET ", 4) != 0)
+                return;
+
+            scratch& sc = scratch_[this_worker()->id];
+            std::vector<char>& body = sc.body;
+
+            std::size_t len = render_metrics(*source_, sc.snap.data(), body.data(), body.size());
+
+            // Queried on the admin worker, data workers never wait for netlink
+            if (len && diag_)
+            {
+                std::lock_guard<std::mutex> lock(diaglock_);
+
+                diag_->refresh();
+
+                const std::size_t difflen = render_diag(*diag_, body.data() + len, body.size() - len);
+                len = difflen ? len + difflen : 0;
+            }
+
+            char head[128];
+            const int headlen = len ? std::snprintf(head, sizeof(head),
+                                                    "HTTP/1.1 200 OK\r\n"
+                                                    "Content-Type: text/plain; version=0.0.4\r\n"
+                                                    "Content-Length: %zu\r\n"
+                                                    "Connection: close\r\n\r\n", len)
+                                    : std::snprintf(head, sizeof(head),
+                                                    "HTTP/1.1 500 Internal Server Error\r\n"
+                                                    "Content-Length: 0\r\n"
+                                                    "Connection: close\r\n\r\n");
+
+            // Answered with Connection: close, also when the client stops reading
+            if (write_all(sfd, head, headlen))
+                write_all(sfd, body.data(), len);
+
+            disconnect(sfd);
+        }
+
+    private:
+
+        // Per-worker rendering buffers
+        struct scratch {
+            std::vector<char> body;
+            std::vector<worker_stats> snap;
+        };
+
+        std::shared_ptr<const stats_segment> source_;
+
+        std::shared_ptr<sock_diag> diag_;
+        std::mutex diaglock_;
+
+        std::vector<scratch> scratch_;
+
+        /*! Writes until done, waiting up to METRICS_WRITE_TIMEOUT in all for the socket to drain;
+         *  only blocks the admin worker
+         */
+        static bool write_all(const int sfd, const char* data, std::size_t datalen) {
+
+            int timeout = METRICS_WRITE_TIMEOUT;
+
+            while (datalen)
+            {
+                // A scraper that hung up must not raise SIGPIPE in the server process
+                const int n = static_cast<int>(::send(sfd, data, datalen, MSG_NOSIGNAL));
+                if (n > 0)
+                {
+                    data += n;
+                    datalen -= n;
+                    continue;
+                }
+
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR))
+                    return false;
+
+                if (errno == EINTR)
+                    continue;
+
+                struct pollfd pfd = { sfd, POLLOUT, 0 };
+
+                const std::uint64_t start = detail::now();
+                if (timeout <= 0 || ::poll(&pfd, 1, timeout) <= 0)
+                    return false;
+
+                timeout -= static_cast<int>((detail::now() - start) / 1000000);
+            }
+
+            return true;
+        }
+    };
+}
+
+#endif
@@ -4,26 +4,61 @@
 #ifndef _COMM_POOL_HPP
 #define _COMM_POOL_HPP
 
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <type_traits>
 #include <vector>
 
 #include <sys/ioctl.h>
 
 #include "atomic_queue.hpp"
+#include "buffer.hpp"
+#include "capture.hpp"
+#include "epoch.hpp"
 #include "epoll.hpp"
+#include "stats.hpp"
+#include "table.hpp"
+#include "uring.hpp"
+
+#ifdef COMM_CONTENTION_STATS
+#define COMM_CONTENTION_POOL_COUNT(field) field.fetch_add(1, std::memory_order_relaxed)
+#else
+#define COMM_CONTENTION_POOL_COUNT(field) ((void)0)
+#endif
 
 namespace comm {
 
     class client_pool_base {  };
     class server_pool_base {  };
 
+    //! @struct conn_input
+    /*! data read from one connection, staged for client_pool::on_input_batch()
+     */
+    struct conn_input {
+        int sfd;
+        connection_ref ref;
+        slice data;
+    };
+
+    //! client_pool::add_client() results
+    enum class add_result {
+        ADDED,   // registered, the pool owns the socket
+        FULL,    // at client capacity, the caller may shed the connection
+        FAILED   // couldn't register with epoll, the caller closes the socket
+    };
+
+    // Fwd. decl.
+    template <typename T> class server_pool;
+
     //! @class client_pool
-    /*! encapsulates event handling for multiple clients
+    /*! encapsulates event handling for multiple clients; Talloc backs the client slab, connection
+     *  table and unused client queue (see mem.hpp)
      */
-    template <typename Tderiv>
+    template <typename Tderiv, typename Talloc = mirror_alloc>
     class client_pool : public client_pool_base,
-                        public epoll<client_pool<Tderiv> > {
+                        public epoll<client_pool<Tderiv, Talloc> > {
     public:
 
         //! dtor.
@@ -33,36 +68,308 @@ namespace comm {
             std::lock_guard<std::mutex> lock(lock_);
 
             unused_.destroy();
-            del_memmap<client>(mem_, clientcap_);
+            free_array<Talloc>(mem_, clientcap_);
         }
 
         //! ctor.
         //! @param nworkers     client handler thread count
         //! @param clientcap    maximum number of clients
         client_pool(const std::size_t nworkers, std::size_t clientcap) : nworkers_(nworkers)
-                                                                       , mem_(gen_memmap<client>(&clientcap))
+                                                                       , mem_(alloc_array<Talloc, client>(&clientcap))
                                                                        , clientcap_(clientcap)
                                                                        , clientsize_(0)
-                                                                       , unused_(clientcap) {
+                                                                       , table_(clientcap)
+                                                                       , epochs_(nworkers)
+                                                                       , unused_(clientcap)
+                                                                       , tcpinfoevery_(0)
+                                                                       , retransthreshold_(0)
+                                                                       , timestamps_(false)
+                                                                       , threadprefix_("comm")
+                                                                       , readmin_(BUFFER_DEFAULT_TIER)
+                                                                       , readmax_(BUFFER_DEFAULT_TIER)
+                                                                       , fionread_(false)
+                                                                       , parkidle_(0)
+                                                                       , sweep_(nworkers, 0)
+                                                                       , batches_(nworkers)
+                                                                       , prefetch_(0)
+                                                                       , prefetchbuffers_(false)
+                                                                       , batchcloses_(false)
+                                                                       , asynccloses_(false) {
+
+#ifdef COMM_CONTENTION_STATS
+            capacity_rejects_.store(0);
+#endif
 
             client** data = unused_.data();
 
             std::size_t i = 0;
             for ( ; i != clientcap; ++i)
                 data[i] = &mem_[i];
+
+            attach(std::make_shared<stats_segment>(nworkers_), 0);
+        }
+
+        //! Publishes counters to a named shared memory segment, readable by tools/commtop
+        //! Must be called before run()
+        //! @param name    shared memory object name, e.g. "/myserver"
+        bool publish(const char* name) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            try
+            {
+                attach(std::make_shared<stats_segment>(nworkers_, name), 0);
+            }
+
+            catch (std::runtime_error&) {
+                return false;
+            }
+
+            return true;
+        }
+
+        //! Enables sampling of getsockopt(TCP_INFO) into the per-listener histograms
+        //! @param every        sample every Nth successful read of a connection, 0 disables sampling
+        //! @param threshold    retransmits between two samples that trigger on_retransmit(), 0 disables the hook
+        //! Must be called before run()
+        bool sample_tcp_info(const unsigned every, const unsigned threshold = 0) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            retransthreshold_ = threshold;
+            tcpinfoevery_ = every;
+            return true;
+        }
+
+        //! Enables software receive timestamps on new connections; the delay between the kernel
+        //! stamping a packet and the worker reading it goes into the per-worker rxdelay histogram.
+        //! Reads then use recvmsg() instead of recv(). Must be called before run()
+        //! @param enable    true to enable
+        bool timestamp_input(const bool enable) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            timestamps_ = enable;
+            return true;
+        }
+
+        //! Sets the prefix of the worker thread names, "comm" by default, e.g. "admin" for "admin-worker-0";
+        //! names are cut to the kernel's 15 characters. Must be called before run()
+        //! @param prefix    thread name prefix
+        bool name_threads(const char* prefix) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            threadprefix_ = prefix;
+            return true;
+        }
+
+        //! Enables adaptive read sizes. Each connection's receive buffer starts at MAX_READ_SIZE
+        //! (clamped to the limits), moves up a tier when a read fills it and down a tier after a run of
+        //! reads that would have fit a quarter of it. Buffers come from per-thread tiered pools.
+        //! Must be called before run()
+        //! @param minsize     smallest read size, rounded up to a tier (256 bytes to 64 KiB)
+        //! @param maxsize     largest read size, rounded up to a tier
+        //! @param fionread    on a full read, size the next one by the bytes still queued (FIONREAD)
+        //!                    instead of growing one tier at a time
+        bool read_sizing(const std::size_t minsize, const std::size_t maxsize, const bool fionread = false) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty() || minsize > maxsize)
+                return false;
+
+            readmin_ = buffer_tier(minsize);
+            readmax_ = buffer_tier(maxsize);
+            fionread_ = fionread;
+
+            return true;
+        }
+
+        //! Parks idle connections: once a connection has had no event for the threshold, its receive
+        //! buffer goes back to the pools and is taken again on its next read, leaving only the client
+        //! slot (and the connection arena, if the handler made one). Workers sweep a share of the
+        //! slots on every CPU usage sample. Must be called before run()
+        //! @param msec    idle time before parking, 0 disables parking
+        bool park_idle(const unsigned msec) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            parkidle_ = msec;
+            return true;
+        }
+
+        //! Prefetches the state of connections a few events ahead while a worker dispatches an epoll
+        //! batch: the connection table entries and client record, and optionally the start of the
+        //! receive buffer. Worth it for large batches over many connections, see tools/prefetch_bench.
+        //! Must be called before run()
+        //! @param distance    events ahead, 0 disables prefetching
+        //! @param buffers     also prefetch receive buffers, ignored while idle parking is enabled
+        bool prefetch_ahead(const unsigned distance, const bool buffers = false) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            prefetch_ = static_cast<int>(distance);
+            prefetchbuffers_ = buffers;
+            return true;
+        }
+
+        //! Closes a connection, from its callbacks or any other thread: reads are shut down, so the worker
+        //! owning it reads what is left and closes it on its next event (or once the current callback
+        //! returns). The socket of a closed connection stays open until no thread can still address it,
+        //! so a number passed here is never that of an unrelated, newer connection.
+        //! @param sfd      client socket
+        //! @param reset    abort with RST (SO_LINGER 0) instead of FIN, leaving no FIN_WAIT or TIME_WAIT
+        //!                 socket behind; for abusive clients and load shedding
+        //! @return         false if the socket isn't a client of this pool
+        bool disconnect(const int sfd, const bool reset = false) {
+
+            // A connection closing meanwhile keeps its socket open while the guard is held
+            epoch_guard guard(epochs_);
+
+            const connection_ref ref = table_.find(sfd);
+            if (!table_.alive(ref))
+                return false;
+
+            if (reset && endpoint_linger_reset(sfd) == 0)
+                mem_[ref.slot].reset.store(1, std::memory_order_relaxed);
+
+            return endpoint_shutdown_read(sfd) == 0;
+        }
+
+        //! Batches the closes of each worker: sockets of closed clients are closed together before the
+        //! next epoll_wait() that finds them no longer addressed, in one io_uring submission where the kernel
+        //! supports it (close() calls otherwise), so mass disconnects don't stall dispatch on socket
+        //! teardown. Must be called before run()
+        //! @param async    have the kernel's worker threads run the io_uring closes
+        bool batch_closes(const bool async = true) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            batchcloses_ = true;
+            asynccloses_ = async;
+            return true;
+        }
+
+        //! Records connects, inbound data and disconnects to a memory-mapped file, see tools/replay
+        //! Must be called before run()
+        //! @param path        capture file, truncated
+        //! @param capacity    maximum file size, later records are dropped
+        bool capture(const char* path, const std::size_t capacity) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!threads_.empty())
+                return false;
+
+            try
+            {
+                capture_.reset(new capture_file(path, capacity));
+            }
+
+            catch (std::runtime_error&) {
+                return false;
+            }
+
+            return true;
+        }
+
+#ifdef COMM_CONTENTION_STATS
+        //! Contention counters of the unused client queue, built with COMM_CONTENTION_STATS
+        //! @param[out] capacityrejects    clients refused because every slot was in use
+        queue_contention contention(std::uint64_t* const capacityrejects = nullptr) const {
+
+            if (capacityrejects)
+                *capacityrejects = capacity_rejects_.load(std::memory_order_relaxed);
+
+            return unused_.contention();
+        }
+#endif
+
+        //! Finds the client on a socket, lock-free, e.g. to address a connection from outside its
+        //! callbacks or to index per-connection data by slot. The socket number may be reused once
+        //! the connection closes; alive() tells whether the reference still holds.
+        //! @param sfd    socket file descriptor
+        //! @return       slot and generation, invalid if the socket isn't a client of this pool
+        connection_ref find(const int sfd) const {
+            return table_.find(sfd);
+        }
+
+        //! Checks that a connection found by find() is still open
+        //! @param ref    connection reference
+        bool alive(const connection_ref& ref) const {
+            return table_.alive(ref);
+        }
+
+        //! Epochs of this pool's workers; an epoch_guard on them keeps closed clients from being reused
+        //! while another thread reads per-slot data of connections it found
+        epoch_domain& epochs() {
+            return epochs_;
+        }
+
+        //! Returns the segment holding the worker counters
+        //!
+        std::shared_ptr<const stats_segment> stats() const {
+            return stats_;
         }
 
         //! Adds a new client
-        //! @param sfd    file descriptor
-        bool add_client(const int sfd) {
+        //! @param sfd         file descriptor
+        //! @param listener    index of the accepting listener, selects the TCP_INFO histograms
+        //! @return            see add_result; the socket stays the caller's unless ADDED
+        add_result add_client(const int sfd, const std::uint32_t listener = 0) {
 
             // Ensure that we haven't exceeded client capacity
             if (clientsize_.load() == clientcap_)
-                return false;
+            {
+                COMM_CONTENTION_POOL_COUNT(capacity_rejects_);
+                return add_result::FULL;
+            }
 
-            client* const cl = use(sfd);
-            const int ret = epoll<client_pool>::add(cl);
-            return ret == 0;
+            if (timestamps_)
+                endpoint_rx_timestamps(sfd);
+
+            client* const cl = use(sfd, listener);
+
+            if (capture_)
+                capture_->record(slot(cl), CAPTURE_OPEN);
+
+            const std::uint32_t s = slot(cl);
+            if (epoll<client_pool>::add(sfd, table_type::key(s, table_.gen()[s].load(std::memory_order_relaxed))) != 0)
+            {
+                // No event can reach the slot, hand it back; the caller closes the socket
+                if (capture_)
+                    capture_->record(s, CAPTURE_CLOSE);
+
+                table_.unindex(sfd);
+                table_.retire(s);
+                reclaim(cl);
+                return add_result::FAILED;
+            }
+
+            ++detail::stats().opens;
+            return add_result::ADDED;
         }
 
         //! Starts instance
@@ -73,10 +380,19 @@ namespace comm {
 
             if (threads_.empty())
             {
+                for (std::size_t i = 0; batchcloses_ && i != nworkers_; ++i)
+                {
+                    rings_.emplace_back(new close_ring(CLOSE_RING_ENTRIES, asynccloses_));
+                    if (!rings_.back()->valid())
+                        rings_.back().reset();
+                }
+
                 for (std::size_t i = 0; i != nworkers_; ++i)
                 {
-                    threads_.emplace_back([this] {
-                        epoll<client_pool<Tderiv> >::wait();
+                    threads_.emplace_back([this, i] {
+                        detail::name_thread(threadprefix_.c_str(), "worker", static_cast<int>(i));
+                        epoll<client_pool<Tderiv, Talloc> >::wait(workers_[i]);
+                        epochs_.offline(i);
                     });
                 }
             }
@@ -91,15 +407,45 @@ namespace comm {
             if (threads_.empty())
                 return; // Nothing to do
 
-            epoll<client_pool<Tderiv> >::close();
+            epoll<client_pool<Tderiv, Talloc> >::close();
 
             for (std::size_t i = 0; i != threads_.size(); ++i)
                 threads_[i].join();
 
+            for (std::size_t i = 0; i != workers_.size(); ++i)
+                close_batch(workers_[i]);
+
+            // Each ring drains its in-flight closes on destruction, before the sockets below are closed
+            rings_.clear();
+
+            // Scans the socket array, client records are only touched for open connections
+            int* const fds = table_.fd();
             for (std::size_t i = 0; i != clientcap_; ++i)
             {
-                if (mem_->sfd)
-                    endpoint_close(mem_->sfd);
+                if (fds[i] == 0)
+                    continue;
+
+                table_.unindex(fds[i]);
+                endpoint_close(fds[i]);
+                fds[i] = 0;
+
+                delete mem_[i].scratch;
+                mem_[i].scratch = nullptr;
+
+                if (mem_[i].rbuff)
+                    buffer_pool::release(mem_[i].rbuff);
+                mem_[i].rbuff = nullptr;
+            }
+
+            // No worker reads anymore, retired clients can be reused
+            for (std::size_t i = 0; i != workers_.size(); ++i)
+            {
+                std::deque<retired_client>& retired = workers_[i].retired;
+                for ( ; !retired.empty(); retired.pop_front())
+                {
+                    endpoint_close(retired.front().sfd);
+                    reclaim(retired.front().cl);
+                }
             }
         }
 
@@ -121,21 +467,108 @@ namespace comm {
             (void)datalen;
         }
 
+        //! Override to read directly into application memory. Called before each read; the destinations
+        //! are filled with readv() and passed to on_input_direct().
+        //! @param sfd       file descriptor about to be read
+        //! @param iov       destinations to fill in
+        //! @param maxiov    capacity of iov, MAX_READ_TARGETS
+        //! @return          number of destinations, at most maxiov; 0 (or destinations of no length in
+        //!                  total) to read into the pool's buffer as usual
+        inline int on_read_target(int sfd, struct iovec* iov, int maxiov) {
+            (void)sfd;
+            (void)iov;
+            (void)maxiov;
+            return 0;
+        }
+
+        //! Called with data read into the destinations supplied by on_read_target()
+        //! @param sfd       triggered file descriptor
+        //! @param iov       destinations, as supplied
+        //! @param iovcnt    number of destinations
+        //! @param nbytes    bytes read, filling the destinations in order
+        inline void on_input_direct(int sfd, const struct iovec* iov, int iovcnt, int nbytes) {
+            (void)sfd;
+            (void)iov;
+            (void)iovcnt;
+            (void)nbytes;
+        }
+
+        //! Override instead of on_input() to receive data as a slice of a pooled, refcounted buffer.
+        //! The slice may be kept or moved to another thread; the buffer is recycled once every slice
+        //! of it has been released.
+        //! @param sfd     triggered file descriptor
+        //! @param data    received data
+        inline void on_input_slice(int sfd, slice data) {
+            (void)sfd;
+            (void)data;
+        }
+
         //! Override this to handle output-ready events
         //! @param sfd    triggered file descriptor
         inline void on_write_ready(int sfd) {
             (void)sfd;
         }
 
+        //! Override to choose how connections dropped at capacity (see server_pool) are closed. A reset
+        //! frees the socket at once, where a graceful close would leave it in FIN_WAIT or TIME_WAIT.
+        //! @param sfd         accepted socket about to be closed
+        //! @param listener    index of the accepting listener
+        //! @return            true to close with RST (SO_LINGER 0), false for a graceful close
+        inline bool on_shed(int sfd, std::uint32_t listener) {
+            (void)sfd;
+            (void)listener;
+            return true;
+        }
+
+        //! Override instead of on_input() to receive the input of a whole epoll batch at once, e.g. to
+        //! validate requests or look them up in a shared index with prefetching across connections.
+        //! Each ready connection is read once into a pooled buffer and staged; the batch is passed at
+        //! the end of the iteration, before on_loop_end(). The connections stay open and are not
+        //! re-armed until this returns, so no other worker reads them meanwhile; data left in their
+        //! sockets is reported again on re-arming. Slices may be moved out to keep them.
+        //! @param inputs    staged input, in event order
+        //! @param count     number of inputs
+        inline void on_input_batch(conn_input* inputs, std::size_t count) {
+            (void)inputs;
+            (void)count;
+        }
+
+        //! Override to prepare for a batch of events, e.g. to start collecting responses; called by each
+        //! worker once per epoll_wait() that returned events, before dispatching them. Per-worker state
+        //! can be indexed by this_worker()->id.
+        //! @param nevents    events in the batch, connections and watchers
+        inline void on_loop_begin(int nevents) {
+            (void)nevents;
+        }
+
+        //! Override to finish a batch of events, e.g. to flush the responses or commit the log records
+        //! the batch's callbacks deferred; called by each worker after dispatching the batch
+        inline void on_loop_end() {  }
+
+        //! Override this to flag connections with chronic retransmits, see sample_tcp_info()
+        //! @param sfd        sampled file descriptor
+        //! @param info       sampled TCP_INFO
+        //! @param retrans    retransmits since the previous sample
+        inline void on_retransmit(int sfd, const struct tcp_info& info, unsigned retrans) {
+            (void)sfd;
+            (void)info;
+            (void)retrans;
+        }
+
     private:
 
-        friend epoll<client_pool<Tderiv> >;
+        friend epoll<client_pool<Tderiv, Talloc> >;
+        template <typename> friend class server_pool;
 
         // Applied to critical section when starting and stopping the running instance
         std::mutex lock_;
 
         std::size_t nworkers_;
         std::vector<std::thread> threads_;
+        std::vector<worker> workers_;
+
+        // Worker counters, possibly shared with a server_pool
+        std::shared_ptr<stats_segment> stats_;
 
         // Allocated slab of memory, maximum client size
         client* mem_;
@@ -143,39 +576,383 @@ namespace comm {
         std::size_t clientcap_;
         std::atomic<std::size_t> clientsize_;
 
+        // Hot per-connection fields, by slot
+        typedef connection_table<Talloc> table_type;
+        table_type table_;
+
+        // Delays reuse of closed clients past threads still reading them
+        epoch_domain epochs_;
+
         // Pointers to currently unused clients
-        atomic_queue<client*> unused_;
+        atomic_queue<client*, Talloc> unused_;
+
+#ifdef COMM_CONTENTION_STATS
+        // Clients refused at capacity, before dequeuing; unlike the queue's counters, kept inline
+        std::atomic<std::uint64_t> capacity_rejects_;
+#endif
+
+        // TCP_INFO sampling interval (reads) and on_retransmit() threshold
+        unsigned tcpinfoevery_;
+        unsigned retransthreshold_;
+
+        // Software receive timestamps enabled
+        bool timestamps_;
+
+        // Worker thread name prefix, see name_threads()
+        std::string threadprefix_;
+
+        // Traffic capture, if enabled
+        std::unique_ptr<capture_file> capture_;
+
+        // Receive buffer tier limits, and whether growth is sized by FIONREAD
+        int readmin_, readmax_;
+        bool fionread_;
+
+        // Small reads in a row before a receive buffer shrinks
+        static const int SHRINK_AFTER = 8;
+
+        // Idle time before parking, msec, and each worker's next slot to sweep
+        unsigned parkidle_;
+        std::vector<std::size_t> sweep_;
+
+        // Sweeps visit a worker's share of the slots over this many calls
+        static const std::size_t SWEEP_STEPS = 10;
+
+        /*! @struct input_batch
+         *  a worker's staged input and the connections to re-arm once it has been handled
+         */
+        struct input_batch {
+            std::vector<conn_input> inputs;
+            std::vector<client*> rearms;
+        };
+
+        // Used only when the handler overrides on_input_batch(), by worker
+        std::vector<input_batch> batches_;
+
+        // Events prefetched ahead of dispatch, and whether receive buffers are too
+        int prefetch_;
+        bool prefetchbuffers_;
+
+        // Closes are queued per worker and issued before epoll_wait(), through one ring per worker
+        // (null where io_uring can't close)
+        bool batchcloses_;
+        bool asynccloses_;
+        std::vector<std::unique_ptr<close_ring> > rings_;
+        static const unsigned CLOSE_RING_ENTRIES = 256;
 
         /*! Called on epoll event, casts epoll data value to correct type before passing it to process()
          */
-        client* cast(epoll_data data) {
-            return static_cast<client*>(data.ptr);
+        std::uint64_t cast(epoll_data data) {
+            return data.u64;
+        }
+
+        /*! Moves worker counters to slots [first, first + nworkers) of a segment
+         */
+        void attach(const std::shared_ptr<stats_segment>& seg, const std::size_t first) {
+
+            seg->header()->clientcap = clientcap_;
+
+            stats_slot* const slots = seg->slots() + first;
+            for (std::size_t i = 0; i != nworkers_; ++i)
+            {
+                slots[i].role = STATS_WORKER;
+
+                if (i < workers_.size())
+                    slots[i].data = workers_[i].stats->data;
+            }
+
+            workers_.clear();
+            for (std::size_t i = 0; i != nworkers_; ++i)
+                workers_.emplace_back(static_cast<int>(i), &slots[i]);
+
+            stats_ = seg;
         }
 
         /*! Called on epoll event to processes triggered file descriptor
          */
-        inline void process(client* const cl, const int flags);
+        inline void process(const std::uint64_t key, const int flags);
+
+        /*! Called periodically by each worker, parks idle connections
+         */
+        inline void maintain(worker& w);
+
+        /*! Called by each worker before epoll_wait(), announces the quiescent point, then closes and
+         *  reuses the clients it retired that no thread can still be reading
+         */
+        void quiesce(worker& w) {
+
+            epochs_.quiesce(w.id);
+
+            for ( ; !w.retired.empty() && epochs_.reclaimable(w.retired.front().epoch); w.retired.pop_front())
+            {
+                const retired_client& r = w.retired.front();
+
+                if (batchcloses_)
+                    w.closing.push_back(r.sfd);
+                else
+                    endpoint_close(r.sfd);
+
+                reclaim(r.cl);
+            }
+
+            close_batch(w);
+        }
+
+        /*! Called by each worker before dispatching an epoll batch
+         */
+        void loop_begin(worker&, const int nevents) {
+            static_cast<Tderiv*>(this)->on_loop_begin(nevents);
+        }
+
+        /*! Called by each worker after dispatching an epoll batch
+         */
+        void loop_end(worker& w) {
+
+            if (batched())
+                deliver(w);
+
+            static_cast<Tderiv*>(this)->on_loop_end();
+        }
+
+        /*! Whether the handler overrides on_input_batch()
+         */
+        static constexpr bool batched() {
+            return !std::is_same<decltype(&Tderiv::on_input_batch), decltype(&client_pool::on_input_batch)>::value;
+        }
+
+        /*! Passes a worker's staged input to the handler, then re-arms the connections
+         */
+        void deliver(worker& w) {
+
+            input_batch& batch = batches_[w.id];
+
+            if (!batch.inputs.empty())
+            {
+                static_cast<Tderiv*>(this)->on_input_batch(batch.inputs.data(), batch.inputs.size());
+                batch.inputs.clear();
+                w.scratch.reset();
+            }
+
+            for (std::size_t i = 0; i != batch.rearms.size(); ++i)
+                arm(slot(batch.rearms[i]));
+
+            batch.rearms.clear();
+        }
+
+        /*! Called on epoll batch, events to prefetch ahead
+         */
+        int prefetch_distance() const {
+            return prefetch_;
+        }
+
+        /*! Called on epoll batch for an upcoming event: stage 0 prefetches the table entries and
+         *  client record, stage 1 (later) the receive buffer the record points to
+         */
+        void prefetch(const epoll_data data, const int stage) const {
+
+            if (data.u64 & WATCHER_TAG)
+                return;
+
+            const std::uint32_t s = table_type::key_slot(data.u64);
+
+            if (stage == 0)
+            {
+                __builtin_prefetch(&table_.gen()[s]);
+                __builtin_prefetch(&table_.fd()[s]);
+                __builtin_prefetch(&mem_[s], 1);
+
+                if (parkidle_)
+                    __builtin_prefetch(&table_.state()[s], 1);
+            }
+
+            // The idle sweep may release the buffer concurrently
+            else if (prefetchbuffers_ && parkidle_ == 0)
+            {
+                const buffer* const b = mem_[s].rbuff;
+                if (b)
+                    __builtin_prefetch(b + 1, 1);
+            }
+        }
 
         /*! Closes socket and stores client to unused queue
          */
         void unuse(client* const cl) {
 
-            epoll<client_pool>::remove(cl->sfd);
-            endpoint_close(cl->sfd);
-            cl->sfd = 0;
+            if (capture_)
+                capture_->record(slot(cl), CAPTURE_CLOSE);
+
+            const std::uint32_t s = slot(cl);
+            const int sfd = table_.fd()[s];
+
+            // Workers of this pool close the socket when the client is reused, see quiesce(); it stays in
+            // the epoll set disarmed until then, and events already queued for it carry the old
+            // generation and are dropped
+            worker* const w = detail::current_worker();
+            const bool own = w && static_cast<std::size_t>(w->id) < workers_.size() && &workers_[w->id] == w;
+
+            table_.unindex(sfd);
+            if (!own)
+                endpoint_close(sfd);
+
+            table_.retire(s);
+
+            if (cl->reset.load(std::memory_order_relaxed))
+                ++detail::stats().resets;
+
+            if (cl->rbuff)
+                buffer_pool::release(cl->rbuff);
+            cl->rbuff = nullptr;
+
+            // The slot stays busy until reused, so the idle sweep skips it; process() must not touch it either
+            if (w && w->conn == cl)
+                w->conn = nullptr;
+
+            // Workers of this pool queue the client until other threads are done with it, see quiesce()
+            if (own)
+            {
+                const retired_client r = { epochs_.retire(), cl, sfd };
+                w->retired.push_back(r);
+            }
+
+            else
+                reclaim(cl);
+
+            ++detail::stats().closes;
+        }
+
+        /*! Closes a connection that was accepted beyond capacity, as chosen by on_shed()
+         */
+        void shed(const int sfd, const std::uint32_t listener) {
+
+            if (static_cast<Tderiv*>(this)->on_shed(sfd, listener) && endpoint_linger_reset(sfd) == 0)
+                ++detail::stats().resets;
+
+            endpoint_close(sfd);
+        }
+
+        /*! Closes the sockets a worker queued while batching closes
+         */
+        void close_batch(worker& w) {
+
+            if (w.closing.empty())
+                return;
+
+            close_ring* const ring = w.id < static_cast<int>(rings_.size()) ? rings_[w.id].get() : nullptr;
+            const std::uint64_t failed = ring ? ring->failed() : 0;
+
+            for (std::size_t i = 0; i != w.closing.size(); ++i)
+            {
+                if (ring == nullptr || !ring->close(w.closing[i]))
+                    endpoint_close(w.closing[i]);
+            }
+
+            if (ring)
+            {
+                ring->submit();
+                detail::stats().close_errors += ring->failed() - failed;
+            }
+
+            w.closing.clear();
+        }
+
+        /*! Frees the connection arena of a closed client and stores it to the unused queue
+         */
+        void reclaim(client* const cl) {
+
+            delete cl->scratch;
+            cl->scratch = nullptr;
+
             unused_.enqueue(cl);
             --clientsize_;
         }
 
+        /*! Slot index of a client, stable for the lifetime of the connection
+         */
+        std::uint32_t slot(const client* const cl) const {
+            return static_cast<std::uint32_t>(cl - mem_);
+        }
+
+        /*! Socket of a client
+         */
+        int fd(const client* const cl) const {
+            return table_.fd()[slot(cl)];
+        }
+
         /*! Allocates new client
          */
-        client* use(const int sfd) {
+        client* use(const int sfd, const std::uint32_t listener) {
 
             ++clientsize_;
             void* mem = unused_.dequeue();
-            return new (mem) client(sfd);
+            const int tier = BUFFER_DEFAULT_TIER < readmin_ ? readmin_ : BUFFER_DEFAULT_TIER > readmax_ ? readmax_ : BUFFER_DEFAULT_TIER;
+            client* const cl = new (mem) client(listener, static_cast<std::uint8_t>(tier));
+
+            const std::uint32_t s = slot(cl);
+            table_.fd()[s] = sfd;
+            table_.index(sfd, s);
+            table_.active()[s].store(detail::coarse_msec(), std::memory_order_relaxed);
+            table_.state()[s].store(CLIENT_ARMED, std::memory_order_release);
+            return cl;
+        }
+
+        /*! Re-enables events of a client; with batched input, once the batch has been handled
+         */
+        int rearm(client* const cl) {
+
+            if (batched())
+            {
+                batches_[detail::current_worker()->id].rearms.push_back(cl);
+                return 0;
+            }
+
+            return arm(slot(cl));
+        }
+
+        /*! Hands a slot back to the idle sweep, then re-enables its events; once re-armed, another
+         *  worker may take it, so the state must be set first
+         */
+        int arm(const std::uint32_t s) {
+
+            if (parkidle_)
+                table_.state()[s].store(CLIENT_ARMED, std::memory_order_release);
+
+            return epoll<client_pool>::rearm(table_.fd()[s], table_type::key(s, table_.gen()[s].load(std::memory_order_relaxed)));
         }
 
+        /*! Whether a connection last active at a coarse clock reading is idle for parking; readings
+         *  taken by other workers may be ahead of now
+         */
+        bool idle(const std::uint32_t now, const std::uint32_t active) const {
+            return active <= now && now - active >= parkidle_;
+        }
+
+        /*! Reads once and passes the data to the handler
+         */
+        inline int receive(client* const);
+        inline int stage(client* const);
+        template <typename Tslices>
+        inline int receive(client* const, std::true_type, Tslices);
+        template <typename Tslices>
+        inline int receive(client* const, std::false_type, Tslices);
+        inline int receive(client* const, std::false_type);
+        inline int receive(client* const, std::true_type);
+
+        /*! Reads into one or more buffers
+         */
+        inline int read(client* const, const struct iovec* const, const int);
+
+        /*! Picks the tier of the next read from the size of the last one
+         */
+        inline void size_reads(client* const, const int nbytes, const std::size_t capacity);
+
+        /*! Accounts a successful read, captures it and samples TCP_INFO if due
+         */
+        inline void count_read(client* const, const char* const, const int nbytes);
+
+        /*! Samples TCP_INFO into the current worker's histograms
+         */
+        inline void sample(client* const);
+
         /*! EPOLLOUT
          */
         inline void handle_epollout(client* const);
@@ -190,9 +967,47 @@ namespace comm {
 
     /*! Processes epoll events
      */
-    template <typename Tderiv>
-    void client_pool<Tderiv>::process(client* const client, int flags)
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::process(const std::uint64_t key, int flags)
     {
+        const std::uint32_t s = table_type::key_slot(key);
+
+        // Event for a connection closed since it was queued
+        if (table_.gen()[s].load(std::memory_order_acquire) != table_type::key_gen(key))
+            return;
+
+        client* const client = &mem_[s];
+
+        // Selects the connection arena handed out by connection_arena()
+        worker* const w = detail::current_worker();
+        w->conn = client;
+
+        // Takes the client from the idle sweep, which holds it only while releasing a buffer
+        const bool parking = parkidle_ != 0;
+        std::atomic<std::uint8_t>& state = table_.state()[s];
+
+        if (parking)
+        {
+            // Only armed or parked clients can be taken; anything else is still being handed back
+            while (true)
+            {
+                std::uint8_t current = state.load(std::memory_order_relaxed);
+                if ((current == CLIENT_ARMED || current == CLIENT_PARKED)
+                    && state.compare_exchange_weak(current, CLIENT_BUSY, std::memory_order_acquire, std::memory_order_relaxed))
+                    break;
+
+                if (table_.gen()[s].load(std::memory_order_acquire) != table_type::key_gen(key))
+                {
+                    w->conn = nullptr;
+                    return;
+                }
+
+                ::sched_yield();
+            }
+
+            table_.active()[s].store(detail::coarse_msec(), std::memory_order_relaxed);
+        }
+
         switch (flags)
         {
             case EPOLLHUP:
@@ -200,6 +1015,9 @@ namespace comm {
 
             case EPOLLRDHUP:
             case EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
+
+            case EPOLLHUP | EPOLLRDHUP:
+            case EPOLLHUP | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
             {
                 unuse(client);
                 break;
@@ -211,6 +1029,10 @@ namespace comm {
 
             case EPOLLIN | EPOLLRDHUP:
             case EPOLLIN | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
+
+            // Peer closed both directions, e.g. a unix socket
+            case EPOLLIN | EPOLLHUP | EPOLLRDHUP:
+            case EPOLLIN | EPOLLHUP | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
             {
                 handle_epollin(client); // Also processes hangup (on 0-byte read)
                 break;
@@ -222,6 +1044,9 @@ namespace comm {
 
             case EPOLLPRI | EPOLLRDHUP:
             case EPOLLPRI | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
+
+            case EPOLLPRI | EPOLLHUP | EPOLLRDHUP:
+            case EPOLLPRI | EPOLLHUP | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
             {
                 handle_epollpri(client); // Also process hangup (on 0-byte read)
                 break;
@@ -233,6 +1058,9 @@ namespace comm {
 
             case EPOLLIN | EPOLLPRI | EPOLLRDHUP:
             case EPOLLIN | EPOLLPRI | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
+
+            case EPOLLIN | EPOLLPRI | EPOLLHUP | EPOLLRDHUP:
+            case EPOLLIN | EPOLLPRI | EPOLLHUP | EPOLLRDHUP | EPOLLOUT: // ignore EPOLLOUT
             {
                 handle_epollpri(client); // Also processes hangup (on 0-byte read)
                 break;
@@ -273,32 +1101,94 @@ namespace comm {
                 }
             }
         }
+
+        // A client that is still open went back to the sweep when it was re-armed, see arm()
+        w->conn = nullptr;
+    }
+
+    /*! Publishes the number of clients, then parks idle connections in this worker's share of the slots
+     */
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::maintain(worker& w)
+    {
+        // Readers can't take opens minus closes, the slots holding them are published at different times
+        if (w.id == 0)
+            stats_->header()->clients.store(clientsize_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        if (parkidle_ == 0)
+            return;
+
+        const std::size_t share = (clientcap_ + nworkers_ - 1) / nworkers_;
+        const std::size_t first = w.id * share;
+        const std::size_t last = first + share < clientcap_ ? first + share : clientcap_;
+
+        if (first >= last)
+            return;
+
+        const std::uint32_t now = detail::coarse_msec();
+        std::size_t& next = sweep_[w.id];
+
+        std::atomic<std::uint8_t>* const state = table_.state();
+        std::atomic<std::uint32_t>* const active = table_.active();
+
+        for (std::size_t n = share / SWEEP_STEPS + 1; n != 0; --n, ++next)
+        {
+            if (next < first || next >= last)
+                next = first;
+
+            // Reads the dense arrays only; skips clients being processed, parked clients and unused slots
+            if (state[next].load(std::memory_order_relaxed) != CLIENT_ARMED
+                || !idle(now, active[next].load(std::memory_order_relaxed)))
+                continue;
+
+            std::uint8_t armed = CLIENT_ARMED;
+            if (!state[next].compare_exchange_strong(armed, CLIENT_PARKING, std::memory_order_acquire, std::memory_order_relaxed))
+                continue;
+
+            // An event may have been handled between the two reads
+            if (!idle(now, active[next].load(std::memory_order_relaxed)))
+            {
+                state[next].store(CLIENT_ARMED, std::memory_order_release);
+                continue;
+            }
+
+            client* const cl = &mem_[next];
+            if (cl->rbuff)
+            {
+                buffer_pool::release(cl->rbuff);
+                cl->rbuff = nullptr;
+                cl->small = 0;
+
+                ++w.counters.parks;
+            }
+
+            state[next].store(CLIENT_PARKED, std::memory_order_release);
+        }
     }
 
     /*! EPOLLOUT
      */
-    template <typename Tderiv>
-    void client_pool<Tderiv>::handle_epollout(client* const cl)
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::handle_epollout(client* const cl)
     {
-        static_cast<Tderiv*>(this)->on_write_ready(cl->sfd);
+        static_cast<Tderiv*>(this)->on_write_ready(fd(cl));
     }
 
     /*! EPOLLIN
      */
-    template <typename Tderiv>
-    void client_pool<Tderiv>::handle_epollin(client* const cl)
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::handle_epollin(client* const cl)
     {
         while (true)
         {
-            int nbytes;
-            switch (nbytes = endpoint_read(cl->sfd, cl->buff, static_cast<int>(cl->size)))
+            switch (receive(cl))
             {
                 case -1:
                 {
                     if (errno != EAGAIN)
                         unuse(cl); // Have actual error - done with client
                     else
-                        epoll<client_pool>::rearm(cl);
+                        rearm(cl);
                     return;
                 }
 
@@ -308,10 +1198,15 @@ namespace comm {
                     return;
                 }
 
-                // Have data to process...
+                // Data was processed, read again; staged input is read once per event, see on_input_batch()
                 default:
                 {
-                    static_cast<Tderiv*>(this)->on_input(cl->sfd, cl->buff, nbytes);
+                    if (batched())
+                    {
+                        rearm(cl);
+                        return;
+                    }
+
                     break;
                 }
             }
@@ -320,13 +1215,13 @@ namespace comm {
 
     /*! EPOLLPRI
      */
-    template <typename Tderiv>
-    void client_pool<Tderiv>::handle_epollpri(client* const cl)
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::handle_epollpri(client* const cl)
     {
         while (true)
         {
             int mark;
-            if (::ioctl(cl->sfd, SIOCATMARK, &mark) == -1)
+            if (::ioctl(fd(cl), SIOCATMARK, &mark) == -1)
             {
                 unuse(cl); // Have actual error - done with client
                 break;
@@ -337,8 +1232,8 @@ namespace comm {
                 if (mark)
                 {
                     char oobdata;
-                    if (endpoint_read_oob(cl->sfd, &oobdata) != -1)
-                        on_oob(cl->sfd, oobdata);
+                    if (endpoint_read_oob(fd(cl), &oobdata) != -1)
+                        on_oob(fd(cl), oobdata);
 
                     else
                     {
@@ -348,15 +1243,14 @@ namespace comm {
                 }
             }
 
-            int nbytes;
-            switch ((nbytes = endpoint_read(cl->sfd, cl->buff, static_cast<int>(cl->size))))
+            switch (receive(cl))
             {
                 case -1:
                 {
                     if (errno != EAGAIN)
                         unuse(cl); // Have actual error - done with client
                     else
-                        epoll<client_pool>::rearm(cl);
+                        rearm(cl);
                     return;
                 }
 
@@ -366,16 +1260,277 @@ namespace comm {
                     return;
                 }
 
-                // Have data to process...
+                // Data was processed, read again; staged input is read once per event, see on_input_batch()
                 default:
                 {
-                    static_cast<Tderiv*>(this)->on_input(cl->sfd, cl->buff, nbytes);
+                    if (batched())
+                    {
+                        rearm(cl);
+                        return;
+                    }
+
                     break;
                 }
             }
         }
     }
 
+    /*! Reads once and passes the data to the handler: into on_read_target() destinations if overridden,
+     *  then as a slice if on_input_slice() is overridden, otherwise through client::buff
+     */
+    template <typename Tderiv, typename Talloc>
+    int client_pool<Tderiv, Talloc>::receive(client* const cl)
+    {
+        typedef std::integral_constant<bool, !std::is_same<decltype(&Tderiv::on_read_target),
+                                                           decltype(&client_pool::on_read_target)>::value> direct;
+        typedef std::integral_constant<bool, !std::is_same<decltype(&Tderiv::on_input_slice),
+                                                           decltype(&client_pool::on_input_slice)>::value> slices;
+
+        return batched() ? stage(cl) : receive(cl, direct(), slices());
+    }
+
+    /*! Reads into a pooled buffer staged for on_input_batch()
+     */
+    template <typename Tderiv, typename Talloc>
+    int client_pool<Tderiv, Talloc>::stage(client* const cl)
+    {
+        buffer* const b = buffer_pool::local().acquire(cl->tier);
+        const std::size_t capacity = b->capacity();
+
+        struct iovec iov = { b->data(), capacity };
+        const int nbytes = read(cl, &iov, 1);
+
+        if (nbytes > 0)
+        {
+            count_read(cl, b->data(), nbytes);
+
+            const std::uint32_t s = slot(cl);
+            conn_input input = { fd(cl), { s, table_.gen()[s].load(std::memory_order_relaxed) }, slice(b, nbytes) };
+
+            batches_[detail::current_worker()->id].inputs.push_back(std::move(input));
+            size_reads(cl, nbytes, capacity);
+        }
+
+        else
+            buffer_pool::release(b);
+
+        return nbytes;
+    }
+
+    /*! Reads into destinations supplied by the handler
+     */
+    template <typename Tderiv, typename Talloc>
+    template <typename Tslices>
+    int client_pool<Tderiv, Talloc>::receive(client* const cl, std::true_type, Tslices)
+    {
+        struct iovec iov[MAX_READ_TARGETS];
+
+        int iovcnt = static_cast<Tderiv*>(this)->on_read_target(fd(cl), iov, MAX_READ_TARGETS);
+        if (iovcnt > MAX_READ_TARGETS)
+            iovcnt = MAX_READ_TARGETS;
+
+        // A read of no length would return 0 and look like a disconnection
+        std::size_t total = 0;
+        for (int i = 0; i < iovcnt; ++i)
+            total += iov[i].iov_len;
+
+        if (total == 0)
+            return receive(cl, Tslices());
+
+        const int nbytes = read(cl, iov, iovcnt);
+
+        if (nbytes > 0)
+        {
+            count_read(cl, nullptr, nbytes);
+
+            if (capture_)
+            {
+                int left = nbytes;
+                for (int i = 0; i != iovcnt && left > 0; ++i)
+                {
+                    const int len = static_cast<int>(iov[i].iov_len) < left ? static_cast<int>(iov[i].iov_len) : left;
+                    capture_->record(slot(cl), CAPTURE_DATA, iov[i].iov_base, len);
+                    left -= len;
+                }
+            }
+
+            static_cast<Tderiv*>(this)->on_input_direct(fd(cl), iov, iovcnt, nbytes);
+        }
+
+        return nbytes;
+    }
+
+    /*! Impl.
+     */
+    template <typename Tderiv, typename Talloc>
+    template <typename Tslices>
+    int client_pool<Tderiv, Talloc>::receive(client* const cl, std::false_type, Tslices)
+    {
+        return receive(cl, Tslices());
+    }
+
+    /*! Reads into the client's receive buffer
+     */
+    template <typename Tderiv, typename Talloc>
+    int client_pool<Tderiv, Talloc>::receive(client* const cl, std::false_type)
+    {
+        if (cl->rbuff == nullptr)
+            cl->rbuff = buffer_pool::local().acquire(cl->tier);
+
+        char* const data = cl->rbuff->data();
+        const std::size_t capacity = cl->rbuff->capacity();
+
+        struct iovec iov = { data, capacity };
+        const int nbytes = read(cl, &iov, 1);
+
+        if (nbytes > 0)
+        {
+            count_read(cl, data, nbytes);
+            static_cast<Tderiv*>(this)->on_input(fd(cl), data, nbytes);
+            size_reads(cl, nbytes, capacity);
+        }
+
+        return nbytes;
+    }
+
+    /*! Reads into a pooled buffer handed to the handler as a slice
+     */
+    template <typename Tderiv, typename Talloc>
+    int client_pool<Tderiv, Talloc>::receive(client* const cl, std::true_type)
+    {
+        buffer* const b = buffer_pool::local().acquire(cl->tier);
+        const std::size_t capacity = b->capacity();
+
+        struct iovec iov = { b->data(), capacity };
+        const int nbytes = read(cl, &iov, 1);
+
+        if (nbytes > 0)
+        {
+            count_read(cl, b->data(), nbytes);
+            static_cast<Tderiv*>(this)->on_input_slice(fd(cl), slice(b, nbytes));
+            size_reads(cl, nbytes, capacity);
+        }
+
+        else
+            buffer_pool::release(b);
+
+        return nbytes;
+    }
+
+    /*! Reads into one or more buffers
+     */
+    template <typename Tderiv, typename Talloc>
+    int client_pool<Tderiv, Talloc>::read(client* const cl, const struct iovec* const iov, const int iovcnt)
+    {
+        if (!timestamps_)
+            return iovcnt == 1 ? endpoint_read(fd(cl), iov->iov_base, static_cast<int>(iov->iov_len))
+                               : endpoint_readv(fd(cl), iov, iovcnt);
+
+        struct timespec ts;
+        const int nbytes = endpoint_readv(fd(cl), iov, iovcnt, &ts);
+
+        if (nbytes > 0 && ts.tv_sec)
+        {
+            struct timespec now;
+            ::clock_gettime(CLOCK_REALTIME, &now);
+
+            const std::int64_t delay = (now.tv_sec - ts.tv_sec) * 1000000000LL + (now.tv_nsec - ts.tv_nsec);
+            detail::stats().rxdelay.add(delay > 0 ? delay : 0);
+        }
+
+        return nbytes;
+    }
+
+    /*! Picks the tier of the next read from the size of the last one
+     */
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::size_reads(client* const cl, const int nbytes, const std::size_t capacity)
+    {
+        int tier = cl->tier;
+
+        if (static_cast<std::size_t>(nbytes) == capacity)
+        {
+            cl->small = 0;
+
+            if (tier == readmax_)
+                return;
+
+            int pending;
+            if (fionread_ && ::ioctl(fd(cl), FIONREAD, &pending) == 0)
+                tier = buffer_tier(pending);
+
+            tier = tier > cl->tier ? tier : cl->tier + 1;
+            tier = tier < readmax_ ? tier : readmax_;
+        }
+
+        else if (static_cast<std::size_t>(nbytes) <= capacity / 4 && tier > readmin_)
+        {
+            if (++cl->small != SHRINK_AFTER)
+                return;
+
+            cl->small = 0;
+            --tier;
+        }
+
+        else
+        {
+            cl->small = 0;
+            return;
+        }
+
+        // Next read takes a buffer of the new tier
+        cl->tier = static_cast<std::uint8_t>(tier);
+
+        if (cl->rbuff)
+            buffer_pool::release(cl->rbuff);
+        cl->rbuff = nullptr;
+    }
+
+    /*! Accounts a successful read, captures it and samples TCP_INFO if due
+     */
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::count_read(client* const cl, const char* const data, const int nbytes)
+    {
+        worker_stats& st = detail::stats();
+        ++st.reads;
+        st.bytes_in += nbytes;
+        st.readsize.add(nbytes);
+
+        // Scattered reads are captured by the caller
+        if (capture_ && data)
+            capture_->record(slot(cl), CAPTURE_DATA, data, nbytes);
+
+        const unsigned every = tcpinfoevery_;
+        if (every && ++cl->nreads % every == 0)
+            sample(cl);
+    }
+
+    /*! Samples TCP_INFO into the current worker's histograms
+     */
+    template <typename Tderiv, typename Talloc>
+    void client_pool<Tderiv, Talloc>::sample(client* const cl)
+    {
+        struct tcp_info info;
+        if (endpoint_tcp_info(fd(cl), &info) == -1)
+            return; // Not a TCP socket
+
+        const unsigned retrans = info.tcpi_total_retrans - cl->retrans;
+        cl->retrans = info.tcpi_total_retrans;
+
+        tcp_stats& st = detail::stats().tcp[cl->listener < MAX_LISTENERS ? cl->listener : MAX_LISTENERS - 1];
+        st.rtt.add(info.tcpi_rtt);
+        st.retrans.add(retrans);
+        st.cwnd.add(info.tcpi_snd_cwnd);
+        // glibc's tcp_info stops before tcpi_bytes_sent, full-sized segments approximate the bytes
+        st.unacked.add(static_cast<std::uint64_t>(info.tcpi_unacked) * info.tcpi_snd_mss);
+
+        if (retransthreshold_ && retrans >= retransthreshold_)
+        {
+            ++st.flagged;
+            static_cast<Tderiv*>(this)->on_retransmit(fd(cl), info, retrans);
+        }
+    }
+
     //! @class server_pool
     /*! encapsulates event handling for multiple server sockets and their clients
      */
@@ -386,7 +1541,53 @@ namespace comm {
         //! ctor.
         //! @param nworkers     number of client handler thread
         //! @param clientcap    maximum number of clients
-        server_pool(const std::size_t nworkers, const std::size_t clientcap) : clients_(nworkers, clientcap) {  }
+        //! @param args         any further arguments are forwarded to the client handler ctor.
+        template <typename... Args>
+        server_pool(const std::size_t nworkers,
+                    const std::size_t clientcap,
+                    Args&&... args) : clients_(nworkers, clientcap, std::forward<Args>(args)...)
+                                    , nlisteners_(0) {
+
+            for (int i = 0; i != MAX_LISTENERS; ++i)
+                listenfds_[i].store(-1);
+
+            attach(std::make_shared<stats_segment>(clients_.nworkers_ + 1));
+        }
+
+        //! Publishes listener and worker counters to one named shared memory segment, readable by tools/commtop
+        //! Must be called before run()
+        //! @param name    shared memory object name, e.g. "/myserver"
+        bool publish(const char* name) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+            std::lock_guard<std::mutex> clock(clients_.lock_);
+
+            if (!clients_.threads_.empty())
+                return false;
+
+            try
+            {
+                attach(std::make_shared<stats_segment>(clients_.nworkers_ + 1, name));
+            }
+
+            catch (std::runtime_error&) {
+                return false;
+            }
+
+            return true;
+        }
+
+        //! Returns the client handler
+        //!
+        T& clients() {
+            return clients_;
+        }
+
+        //! Returns the segment holding the worker counters, followed by the listener counters
+        //!
+        std::shared_ptr<const stats_segment> stats() const {
+            return stats_;
+        }
 
         //! Starts listening on all server sockets
         //!
@@ -394,7 +1595,9 @@ namespace comm {
 
             std::lock_guard<std::mutex> lock(lock_);
             clients_.run();
-            epoll<server_pool<T> >::wait();
+
+            // Accepts on the calling thread, which keeps the name its creator gave it
+            epoll<server_pool<T> >::wait(worker_);
         }
 
         //! Stops listening on all server sockets
@@ -417,41 +1620,104 @@ namespace comm {
                 || comm::endpoint_unblock(sfd) == -1)
                 return false;
 
-            const int ret = epoll<server_pool<T> >::add(sfd);
-            return ret == 0;
+            return add(sfd);
         }
 
         //! Adds a listener socket
         //! @param sfd    file descriptor
         bool add(const int sfd) {
 
-            const int ret = epoll<server_pool<T> >::add(sfd);
+            const std::uint32_t id = nlisteners_++;
+            if (id < MAX_LISTENERS)
+                listenfds_[id].store(sfd);
+
+            const int ret = epoll<server_pool<T> >::add(sfd, id);
             return ret == 0;
         }
 
+        //! Returns listener descriptors, indexed by listener index
+        //!
+        std::vector<int> listeners() const {
+
+            std::vector<int> fds;
+            for (int i = 0; i != MAX_LISTENERS && listenfds_[i].load() != -1; ++i)
+                fds.push_back(listenfds_[i].load());
+
+            return fds;
+        }
+
     private:
 
         friend epoll<server_pool<T> >;
 
         /*! Called on epoll event, casts epoll data value to correct type before passing it to process()
          */
-        int cast(epoll_data data) {
-            return static_cast<int>(data.u32);
+        std::uint64_t cast(epoll_data data) {
+            return data.u64;
         }
 
         /*! Called on epoll event to handle connection requests
          */
-        inline void process(const int sfd, const int flags);
+        inline void process(const std::uint64_t key, const int flags);
+
+        /*! Called periodically by the listener thread, nothing to do
+         */
+        void maintain(worker&) {  }
+
+        /*! Called before each epoll_wait(), listeners retire nothing
+         */
+        void quiesce(worker&) {  }
+
+        /*! Called around each epoll batch, nothing to do for listeners
+         */
+        void loop_begin(worker&, const int) {  }
+        void loop_end(worker&) {  }
+
+        /*! Called on epoll batch, listeners have nothing to prefetch
+         */
+        int prefetch_distance() const {
+            return 0;
+        }
+
+        void prefetch(const epoll_data, const int) const {  }
+
+        /*! Moves worker counters to the front of a segment and listener counters to its last slot
+         */
+        void attach(const std::shared_ptr<stats_segment>& seg) {
+
+            clients_.attach(seg, 0);
+
+            stats_slot* const slot = seg->slots() + clients_.nworkers_;
+            slot->role = STATS_LISTENER;
+
+            if (worker_.stats)
+                slot->data = worker_.stats->data;
+
+            worker_.stats = slot;
+            stats_ = seg;
+        }
 
         T clients_;
         std::mutex lock_;
+
+        // Listener indices handed out by bind() and add(), and their descriptors
+        std::atomic<std::uint32_t> nlisteners_;
+        std::atomic<int> listenfds_[MAX_LISTENERS];
+
+        // Listener counters
+        std::shared_ptr<stats_segment> stats_;
+        worker worker_;
     };
 
     /*! Called on epoll event to handle connection requests
      */
     template <typename T>
-    void server_pool<T>::process(const int sfd, const int flags)
+    void server_pool<T>::process(const std::uint64_t key, const int flags)
     {
+        // Descriptor in the lower, listener index in the upper half
+        const int sfd = static_cast<int>(key & 0xffffffff);
+        const std::uint32_t listener = static_cast<std::uint32_t>(key >> 32);
+
         switch (flags)
         {
             case EPOLLERR:
@@ -465,9 +1731,28 @@ namespace comm {
                 int cfd;
                 while ((cfd = endpoint_accept(sfd)) != -1)
                 {
-                    if (endpoint_unblock(cfd) != 0
-                        || !clients_.add_client(cfd)) {
+                    if (endpoint_unblock(cfd) != 0) {
                         endpoint_close(cfd);
+                        ++detail::stats().rejects;
+                    }
+
+                    else {
+                        switch (clients_.add_client(cfd, listener))
+                        {
+                            case add_result::ADDED:
+                                ++detail::stats().accepts;
+                                break;
+
+                            case add_result::FULL:
+                                clients_.shed(cfd, listener);
+                                ++detail::stats().rejects;
+                                break;
+
+                            // Not a capacity decision, on_shed() and its RST don't apply
+                            case add_result::FAILED:
+                                endpoint_close(cfd);
+                                break;
+                        }
                     }
                 }
             }
@@ -11,8 +11,8 @@ namespace comm {
     template <typename T>
     using server = comm::server_pool<T>;
 
-    template <typename T>
-    using client_callback_handler = comm::client_pool<T>;
+    template <typename T, typename Talloc = mirror_alloc>
+    using client_callback_handler = comm::client_pool<T, Talloc>;
 }
 
 #endif
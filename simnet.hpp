@@ -0,0 +1,507 @@
+/* simnet.hpp -- v1.0 -- in-process simulated network for reproducible performance tests
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_SIMNET_HPP
+#define _COMM_SIMNET_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "worker.hpp"
+
+namespace comm {
+
+    //! @struct sim_profile
+    /*! link characteristics, applied in both directions
+     */
+    struct sim_profile {
+
+        // One-way delay, nsec
+        std::uint64_t latency;
+        // Bytes per second, 0 for unlimited
+        std::uint64_t bandwidth;
+        // Probability that a segment is lost; lost segments arrive one rto later, in order
+        double loss;
+        // Retransmission delay, nsec
+        std::uint64_t rto;
+        // Bytes in flight towards the client before the server's writes are backpressured
+        std::size_t window;
+
+        explicit sim_profile(const std::uint64_t lat = 0,
+                             const std::uint64_t bw = 0,
+                             const double l = 0.0,
+                             const std::uint64_t r = 200000000,
+                             const std::size_t w = 1 << 16) : latency(lat), bandwidth(bw), loss(l), rto(r), window(w) {  }
+    };
+
+    //! @class sim_network
+    /*! connects simulated clients to a client_pool through socketpairs. The pool reads and writes its end
+     *  as usual; a shaper thread holds the other end and delays, throttles and drops traffic in both
+     *  directions according to each link's profile. Losses are drawn from a seeded generator, so a
+     *  scenario replays identically for the same seed and call order.
+     */
+    class sim_network {
+    public:
+
+        //! dtor.
+        //!
+        ~sim_network() {
+
+            stop();
+
+            for (std::size_t i = 0; i != links_.size(); ++i)
+            {
+                if (links_[i]->fd != -1)
+                    ::close(links_[i]->fd);
+            }
+
+            ::close(timerfd_);
+            ::close(wakefd_);
+            ::close(epfd_);
+        }
+
+        //! ctor.
+        //! @param seed    loss generator seed
+        explicit sim_network(const std::uint32_t seed = 1) : rng_(seed)
+                                                           , running_(false)
+                                                           , lost_(0) {
+
+            if ((epfd_ = ::epoll_create1(EPOLL_CLOEXEC)) == -1)
+                throw std::runtime_error("failed to create simulated network");
+
+            wakefd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            timerfd_ = ::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+            if (wakefd_ == -1 || timerfd_ == -1 || watch(wakefd_, WAKE_ID) == -1 || watch(timerfd_, TIMER_ID) == -1)
+            {
+                ::close(epfd_);
+                throw std::runtime_error("failed to create simulated network");
+            }
+        }
+
+        //! Creates a link and hands its server end to the pool
+        //! @param pool       client_pool or derived
+        //! @param profile    link characteristics
+        //! @return           link id, -1 on error
+        template <typename Tpool>
+        int connect(Tpool& pool, const sim_profile& profile) {
+
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == -1)
+                return -1;
+
+            std::unique_lock<std::mutex> lock(lock_);
+
+            const int id = static_cast<int>(links_.size());
+            links_.emplace_back(new link(fds[1], profile));
+
+            if (watch(fds[1], static_cast<std::uint32_t>(id)) == -1)
+            {
+                links_.back()->fd = -1;
+                links_.back()->hangup = true;
+                ::close(fds[0]);
+                ::close(fds[1]);
+                return -1;
+            }
+
+            lock.unlock();
+
+            // Pool owns and closes the server end
+            if (pool.add_client(fds[0]) != add_result::ADDED)
+            {
+                ::close(fds[0]);
+                return -1;
+            }
+
+            return id;
+        }
+
+        //! Queues data from the client towards the server
+        //! @param id         link id
+        //! @param data       payload
+        //! @param datalen    payload length
+        bool send(const int id, const void* data, const std::size_t datalen) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            link& l = *links_[id];
+            if (l.closing)
+                return false;
+
+            const char* const p = static_cast<const char*>(data);
+            schedule(id, l.up, l.upfree, std::vector<char>(p, p + datalen));
+
+            return true;
+        }
+
+        //! Closes the client side once queued data has been delivered
+        //! @param id    link id
+        void close(const int id) {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            link& l = *links_[id];
+            if (l.closing)
+                return;
+
+            l.closing = true;
+            schedule(id, l.up, l.upfree, std::vector<char>());
+        }
+
+        //! Bytes delivered to the client
+        //! @param id    link id
+        std::uint64_t delivered(const int id) const {
+            std::lock_guard<std::mutex> lock(lock_);
+            return links_[id]->delivered;
+        }
+
+        //! Time of the last delivery to the client, CLOCK_MONOTONIC nsec
+        //! @param id    link id
+        std::uint64_t last_delivery(const int id) const {
+            std::lock_guard<std::mutex> lock(lock_);
+            return links_[id]->lastdelivery;
+        }
+
+        //! Blocks until the client has received a number of bytes
+        //! @param id         link id
+        //! @param bytes      total bytes delivered to wait for
+        //! @param timeout    nsec
+        //! @return           false on timeout or if the server closed the connection first
+        bool wait_delivered(const int id, const std::uint64_t bytes, const std::uint64_t timeout) {
+
+            std::unique_lock<std::mutex> lock(lock_);
+
+            const link& l = *links_[id];
+            return delivered_.wait_for(lock, std::chrono::nanoseconds(timeout), [&l, bytes] {
+                return l.delivered >= bytes || l.hangup;
+            }) && l.delivered >= bytes;
+        }
+
+        //! Segments lost so far, over all links
+        std::uint64_t lost() const {
+            return lost_.load();
+        }
+
+        //! Starts the shaper thread
+        //!
+        void run() {
+
+            std::lock_guard<std::mutex> lock(lock_);
+
+            if (!running_.exchange(true))
+                thread_ = std::thread(&sim_network::shape, this);
+        }
+
+        //! Stops the shaper thread, undelivered traffic is discarded
+        //!
+        void stop() {
+
+            if (!running_.exchange(false))
+                return;
+
+            wake();
+            thread_.join();
+        }
+
+    private:
+
+        static const std::uint32_t WAKE_ID = 0xffffffff;
+        static const std::uint32_t TIMER_ID = 0xfffffffe;
+
+        // Segment size used to draw losses
+        static const std::size_t SEGMENT_SIZE = 1448;
+        // Delay before retrying a write to a full socket, nsec
+        static const std::uint64_t RETRY_DELAY = 100000;
+
+        /*! @struct segment
+         *  queued data and its arrival time; an empty upstream segment closes the link
+         */
+        struct segment {
+            std::uint64_t due;
+            std::vector<char> data;
+            std::size_t offset;
+        };
+
+        /*! @struct link
+         *  one simulated client
+         */
+        struct link {
+            int fd;
+            sim_profile profile;
+
+            std::deque<segment> up, down;
+            std::uint64_t upfree, downfree;   // time the link finishes serialising queued data, per direction
+
+            std::size_t inflight;             // queued downstream bytes
+            bool armed, closing, hangup;
+
+            std::uint64_t delivered, lastdelivery;
+
+            link(const int f, const sim_profile& p) : fd(f)
+                                                    , profile(p)
+                                                    , upfree(0)
+                                                    , downfree(0)
+                                                    , inflight(0)
+                                                    , armed(true)
+                                                    , closing(false)
+                                                    , hangup(false)
+                                                    , delivered(0)
+                                                    , lastdelivery(0) {  }
+        };
+
+        typedef std::pair<std::uint64_t, std::uint32_t> timer;
+
+        // Links, indexed by id
+        std::vector<std::unique_ptr<link> > links_;
+        // Pending deliveries, earliest first
+        std::priority_queue<timer, std::vector<timer>, std::greater<timer> > timers_;
+
+        std::mt19937 rng_;
+
+        int epfd_, wakefd_, timerfd_;
+        std::thread thread_;
+        std::atomic<bool> running_;
+        std::atomic<std::uint64_t> lost_;
+
+        mutable std::mutex lock_;
+        std::condition_variable delivered_;
+
+        /*! Impl.
+         */
+        int watch(const int fd, const std::uint32_t id) {
+            struct epoll_event ev = {  };
+            ev.events = EPOLLIN;
+            ev.data.u32 = id;
+            return ::epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev);
+        }
+
+        /*! Impl.
+         */
+        void wake() {
+            const std::uint64_t one = 1;
+            (void)::write(wakefd_, &one, sizeof(one));
+        }
+
+        /*! Queues data in one direction; arrival accounts for serialisation, latency and losses,
+         *  and never precedes earlier data on the same link. Called with lock_ held.
+         */
+        void schedule(const int id, std::deque<segment>& q, std::uint64_t& linkfree, std::vector<char>&& data) {
+
+            const sim_profile& p = links_[id]->profile;
+            const std::uint64_t now = detail::now();
+
+            std::uint64_t start = linkfree > now ? linkfree : now;
+            if (p.bandwidth)
+                start += data.size() * 1000000000ULL / p.bandwidth;
+            linkfree = start;
+
+            std::uint64_t due = start + p.latency;
+
+            if (p.loss > 0)
+            {
+                std::uniform_real_distribution<double> draw(0.0, 1.0);
+
+                for (std::size_t off = 0; off < data.size(); off += SEGMENT_SIZE)
+                {
+                    if (draw(rng_) < p.loss)
+                    {
+                        due += p.rto;
+                        ++lost_;
+                    }
+                }
+            }
+
+            // In order delivery, a lost segment holds back everything behind it
+            if (!q.empty() && q.back().due > due)
+                due = q.back().due;
+
+            segment s = { due, std::move(data), 0 };
+            q.push_back(std::move(s));
+
+            timers_.push(timer(due, static_cast<std::uint32_t>(id)));
+            wake();
+        }
+
+        /*! Shaper thread
+         */
+        void shape() {
+
+            detail::name_thread("comm", "simnet", 0);
+
+            struct epoll_event events[64];
+
+            while (running_.load())
+            {
+                std::unique_lock<std::mutex> lock(lock_);
+
+                const std::uint64_t now = detail::now();
+                while (!timers_.empty() && timers_.top().first <= now)
+                {
+                    const std::uint32_t id = timers_.top().second;
+                    timers_.pop();
+                    deliver(id, now);
+                }
+
+                // Sleep until the next delivery or new traffic
+                struct itimerspec its = {  };
+                if (!timers_.empty())
+                {
+                    its.it_value.tv_sec = timers_.top().first / 1000000000;
+                    its.it_value.tv_nsec = timers_.top().first % 1000000000;
+                }
+
+                ::timerfd_settime(timerfd_, TFD_TIMER_ABSTIME, &its, nullptr);
+
+                lock.unlock();
+
+                const int nevents = ::epoll_wait(epfd_, events, 64, -1);
+
+                lock.lock();
+
+                for (int i = 0; i < nevents; ++i)
+                {
+                    const std::uint32_t id = events[i].data.u32;
+
+                    if (id == WAKE_ID || id == TIMER_ID)
+                    {
+                        std::uint64_t n;
+                        (void)::read(id == WAKE_ID ? wakefd_ : timerfd_, &n, sizeof(n));
+                    }
+
+                    else
+                        pull(id);
+                }
+            }
+        }
+
+        /*! Delivers due segments of a link. Called with lock_ held.
+         */
+        void deliver(const std::uint32_t id, const std::uint64_t now) {
+
+            link& l = *links_[id];
+
+            // Towards the server, stops on a full socket
+            while (!l.up.empty() && l.up.front().due <= now && l.fd != -1)
+            {
+                segment& s = l.up.front();
+
+                if (s.data.empty())
+                {
+                    ::epoll_ctl(epfd_, EPOLL_CTL_DEL, l.fd, nullptr);
+                    ::close(l.fd);
+                    l.fd = -1;
+                    l.hangup = true;
+                    delivered_.notify_all();
+                    break;
+                }
+
+                const ssize_t n = ::send(l.fd, s.data.data() + s.offset, s.data.size() - s.offset, MSG_NOSIGNAL);
+                if (n > 0)
+                    s.offset += n;
+
+                if (s.offset == s.data.size())
+                    l.up.pop_front();
+
+                else
+                {
+                    if (n == -1 && errno != EAGAIN)
+                        l.up.clear();
+                    else
+                        timers_.push(timer(now + RETRY_DELAY, id));
+                    break;
+                }
+            }
+
+            // Towards the client
+            bool any = false;
+            while (!l.down.empty() && l.down.front().due <= now)
+            {
+                l.inflight -= l.down.front().data.size();
+                l.delivered += l.down.front().data.size();
+                l.down.pop_front();
+                any = true;
+            }
+
+            if (!any)
+                return;
+
+            l.lastdelivery = now;
+            delivered_.notify_all();
+
+            // Window opened, resume reading the server's output
+            if (!l.armed && l.fd != -1 && l.inflight < l.profile.window)
+            {
+                struct epoll_event ev = {  };
+                ev.events = EPOLLIN;
+                ev.data.u32 = id;
+                ::epoll_ctl(epfd_, EPOLL_CTL_MOD, l.fd, &ev);
+                l.armed = true;
+            }
+        }
+
+        /*! Reads server output into the downstream queue, up to the link's window. Called with lock_ held.
+         */
+        void pull(const std::uint32_t id) {
+
+            link& l = *links_[id];
+            if (l.fd == -1)
+                return;
+
+            char buff[65536];
+            const std::size_t room = l.profile.window - l.inflight;
+
+            const ssize_t n = ::recv(l.fd, buff, room < sizeof(buff) ? room : sizeof(buff), 0);
+            if (n > 0)
+            {
+                l.inflight += n;
+                schedule(static_cast<int>(id), l.down, l.downfree, std::vector<char>(buff, buff + n));
+            }
+
+            else if (n == 0 || errno != EAGAIN)
+            {
+                // Server closed the connection
+                ::epoll_ctl(epfd_, EPOLL_CTL_DEL, l.fd, nullptr);
+                ::close(l.fd);
+                l.fd = -1;
+                l.hangup = true;
+                l.up.clear();
+                delivered_.notify_all();
+                return;
+            }
+
+            // Window full, leave the rest in the server's socket
+            if (l.inflight >= l.profile.window)
+            {
+                struct epoll_event ev = {  };
+                ev.data.u32 = id;
+                ::epoll_ctl(epfd_, EPOLL_CTL_MOD, l.fd, &ev);
+                l.armed = false;
+            }
+        }
+
+        // Non-copyable object
+        explicit sim_network(sim_network&) = delete;
+        explicit sim_network(const sim_network&) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,312 @@
+/* stats.hpp -- v1.0 -- per-worker counters and histograms, optionally published to shared memory
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_STATS_HPP
+#define _COMM_STATS_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sched.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace comm {
+
+    static const int HISTOGRAM_BUCKETS = 32;
+    static const int MAX_LISTENERS = 8;
+
+    static const std::uint64_t STATS_MAGIC = 0x31534d4d4f43ULL; // "COMMS1"
+    static const std::uint32_t STATS_VERSION = 2;
+
+    //! Slot roles
+    enum stats_role : std::uint32_t {
+        STATS_WORKER = 1,   // client_pool worker thread
+        STATS_LISTENER = 2  // server_pool accept thread
+    };
+
+    //! @struct histogram
+    /*! log2-bucketed histogram; bucket 0 counts zeroes, bucket i counts values in [2^(i-1), 2^i)
+     */
+    struct histogram {
+
+        std::uint64_t bucket[HISTOGRAM_BUCKETS];
+        std::uint64_t sum;
+
+        //! Adds a sample
+        //! @param value    sample value
+        void add(const std::uint64_t value) {
+            const int i = value ? 64 - __builtin_clzll(value) : 0;
+            ++bucket[i < HISTOGRAM_BUCKETS ? i : HISTOGRAM_BUCKETS - 1];
+            sum += value;
+        }
+
+        //! Total number of samples
+        std::uint64_t count() const {
+            std::uint64_t n = 0;
+            for (int i = 0; i != HISTOGRAM_BUCKETS; ++i)
+                n += bucket[i];
+            return n;
+        }
+
+        //! Inclusive upper bound of bucket i
+        static std::uint64_t upper(const int i) {
+            return i == 0 ? 0 : (std::uint64_t(1) << i) - 1;
+        }
+    };
+
+    //! @struct tcp_stats
+    /*! sampled TCP_INFO of one listener's connections
+     */
+    struct tcp_stats {
+        histogram rtt;           // smoothed round trip time, usec
+        histogram retrans;       // retransmitted segments since the previous sample
+        histogram cwnd;          // congestion window, segments
+        histogram unacked;       // unacknowledged bytes in flight, segments times the MSS
+        std::uint64_t flagged;   // samples reported to on_retransmit()
+    };
+
+    //! @struct worker_stats
+    /*! counters owned and written by exactly one thread
+     */
+    struct worker_stats {
+        std::uint64_t loops;     // epoll_wait() calls that returned events
+        std::uint64_t events;    // events dispatched
+        std::uint64_t accepts;   // connections accepted
+        std::uint64_t rejects;   // connections dropped at capacity
+        std::uint64_t opens;     // connections added to a client_pool
+        std::uint64_t closes;    // connections closed
+        std::uint64_t resets;    // connections closed with RST (SO_LINGER 0)
+        std::uint64_t close_errors;  // io_uring closes that completed with an error, see batch_closes()
+        std::uint64_t reads;     // successful reads
+        std::uint64_t bytes_in;  // bytes read
+        std::uint64_t parks;     // idle connections whose receive buffers were released
+
+        std::uint64_t wait_ns;      // wall time inside epoll_wait()
+        std::uint64_t dispatch_ns;  // wall time processing events
+        std::uint64_t user_us;      // thread CPU time, sampled
+        std::uint64_t sys_us;
+        std::uint64_t vcsw;         // voluntary context switches, sampled
+        std::uint64_t ivcsw;        // involuntary context switches (preemptions), sampled
+
+        histogram batch;         // events per epoll_wait()
+        histogram readsize;      // bytes per read
+        histogram rxdelay;       // kernel receive timestamp to read, nsec (see timestamp_input())
+
+        // TCP_INFO samples, by listener index; listeners past MAX_LISTENERS share the last entry
+        tcp_stats tcp[MAX_LISTENERS];
+    };
+
+    //! @struct stats_slot
+    /*! seqlock-protected worker_stats, one per thread, cache-line aligned
+     */
+    struct alignas(64) stats_slot {
+        std::atomic<std::uint32_t> seq;
+        std::uint32_t role;
+        worker_stats data;
+    };
+
+    //! @struct stats_header
+    /*! segment header, followed by nslots stats_slot entries
+     */
+    struct alignas(64) stats_header {
+        std::uint64_t magic;
+        std::uint32_t version;
+        std::uint32_t nslots;
+        std::uint64_t clientcap;
+        std::atomic<std::uint64_t> clients;  // client slots in use, refreshed by the first worker
+        std::int64_t pid;
+    };
+
+    //! Opens a seqlock write section; called by the owning thread only
+    //! @param s    slot
+    inline void stats_begin(stats_slot* const s) {
+        s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    //! Closes a seqlock write section
+    //! @param s    slot
+    inline void stats_end(stats_slot* const s) {
+        s->seq.store(s->seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    //! Copies a thread's counters to its slot in one short write section
+    //! @param s       slot
+    //! @param data    counters accumulated by the owning thread
+    inline void stats_publish(stats_slot* const s, const worker_stats& data) {
+        stats_begin(s);
+        std::memcpy(&s->data, &data, sizeof(worker_stats));
+        stats_end(s);
+    }
+
+    //! Takes a consistent snapshot of a slot without blocking its writer
+    //! @param s          slot
+    //! @param out        snapshot
+    //! @param retries    attempts before giving up
+    //! @return           true if the snapshot is consistent
+    inline bool stats_read(const stats_slot* const s,
+                           worker_stats* const out,
+                           int retries = 64)
+    {
+        while (retries--)
+        {
+            const std::uint32_t seq = s->seq.load(std::memory_order_acquire);
+            if (seq & 1)
+            {
+                ::sched_yield(); // Writer is mid-publish, which lasts one memcpy
+                continue;
+            }
+
+            std::memcpy(out, &s->data, sizeof(worker_stats));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (s->seq.load(std::memory_order_relaxed) == seq)
+                return true;
+        }
+
+        return false;
+    }
+
+    //! @class stats_segment
+    /*! memory holding a stats_header and its slots; either anonymous or a named POSIX shared memory object
+     */
+    class stats_segment {
+    public:
+
+        //! dtor.
+        //!
+        ~stats_segment() {
+
+            ::munmap(mem_, size_);
+
+            if (owner_ && !name_.empty())
+                ::shm_unlink(name_.c_str());
+        }
+
+        //! ctor. Creates a segment
+        //! @param nslots    number of slots
+        //! @param name      shared memory object name (e.g. "/myserver"), nullptr for anonymous memory
+        stats_segment(const std::size_t nslots, const char* name = nullptr) : size_(sizeof(stats_header) + nslots * sizeof(stats_slot))
+                                                                            , owner_(true) {
+            if (name == nullptr)
+            {
+                mem_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (mem_ == MAP_FAILED)
+                    throw std::runtime_error("memory allocation error");
+            }
+
+            else
+            {
+                int fd;
+                if ((fd = ::shm_open(name, O_CREAT | O_TRUNC | O_RDWR, 0644)) == -1)
+                    throw std::runtime_error("failed to create stats segment");
+
+                if (::ftruncate(fd, size_) == -1)
+                {
+                    ::close(fd);
+                    ::shm_unlink(name);
+                    throw std::runtime_error("failed to create stats segment");
+                }
+
+                mem_ = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                ::close(fd);
+
+                if (mem_ == MAP_FAILED)
+                {
+                    ::shm_unlink(name);
+                    throw std::runtime_error("failed to create stats segment");
+                }
+
+                name_ = name;
+            }
+
+            std::memset(mem_, 0, size_);
+
+            stats_header* const hdr = header();
+            hdr->version = STATS_VERSION;
+            hdr->nslots = static_cast<std::uint32_t>(nslots);
+            hdr->pid = ::getpid();
+
+            // Published last, readers check it before trusting the layout
+            std::atomic_thread_fence(std::memory_order_release);
+            hdr->magic = STATS_MAGIC;
+        }
+
+        //! ctor. Attaches read-only to an existing named segment
+        //! @param name    shared memory object name
+        explicit stats_segment(const char* name) : owner_(false) {
+
+            int fd;
+            if ((fd = ::shm_open(name, O_RDONLY, 0)) == -1)
+                throw std::runtime_error("failed to open stats segment");
+
+            struct stat st;
+            if (::fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < sizeof(stats_header))
+            {
+                ::close(fd);
+                throw std::runtime_error("failed to open stats segment");
+            }
+
+            size_ = st.st_size;
+            mem_ = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);
+
+            if (mem_ == MAP_FAILED)
+                throw std::runtime_error("failed to open stats segment");
+
+            const stats_header* const hdr = header();
+            if (hdr->magic != STATS_MAGIC
+                || hdr->version != STATS_VERSION
+                || size_ < sizeof(stats_header) + hdr->nslots * sizeof(stats_slot))
+            {
+                ::munmap(mem_, size_);
+                throw std::runtime_error("incompatible stats segment");
+            }
+        }
+
+        stats_header* header() {
+            return static_cast<stats_header*>(mem_);
+        }
+
+        const stats_header* header() const {
+            return static_cast<const stats_header*>(mem_);
+        }
+
+        stats_slot* slots() {
+            return reinterpret_cast<stats_slot*>(header() + 1);
+        }
+
+        const stats_slot* slots() const {
+            return reinterpret_cast<const stats_slot*>(header() + 1);
+        }
+
+        std::size_t size() const {
+            return header()->nslots;
+        }
+
+    private:
+
+        // Mapped memory
+        void* mem_;
+        std::size_t size_;
+
+        // Shared memory object name, empty if anonymous
+        std::string name_;
+        // Creator unlinks the name on destruction
+        bool owner_;
+
+        // Non-copyable object
+        explicit stats_segment(stats_segment&) = delete;
+        explicit stats_segment(const stats_segment&) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,207 @@
+/* table.hpp -- v1.0 -- slot-indexed arrays of hot per-connection metadata
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_TABLE_HPP
+#define _COMM_TABLE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <new>
+
+#include <sys/resource.h>
+
+#include "mem.hpp"
+
+namespace comm {
+
+    //! Connection states, for idle parking
+    enum client_state : std::uint8_t {
+        CLIENT_ARMED,    // waiting for an event
+        CLIENT_BUSY,     // a worker is processing an event, or the slot is unused
+        CLIENT_PARKING,  // the idle sweep is releasing its buffers
+        CLIENT_PARKED    // waiting for an event, buffers released
+    };
+
+    // Upper bound on the fd index, when RLIMIT_NOFILE is unlimited or larger
+    static const std::size_t MAX_FD_INDEX = 1 << 24;
+
+    //! @struct connection_ref
+    /*! generation-checked reference to a connection, see client_pool::find()
+     */
+    struct connection_ref {
+        std::uint32_t slot;
+        std::uint32_t gen;   // 0 for no connection
+
+        bool valid() const {
+            return gen != 0;
+        }
+    };
+
+    //! @class connection_table
+    /*! hot per-connection fields as separate arrays indexed by client slot, each page (and so cache-line)
+     *  aligned. Sweeps over all connections read only the arrays they need, densely packed, instead of
+     *  striding over whole client records; the rest of a connection lives in its client record and its
+     *  buffers in the buffer pools. A direct-indexed array, sized to RLIMIT_NOFILE at construction,
+     *  maps sockets back to slots. Arrays come from the pool's allocator policy, see mem.hpp.
+     */
+    template <typename Talloc = mirror_alloc>
+    class connection_table {
+    public:
+
+        //! dtor.
+        //!
+        ~connection_table() {
+            free_array<Talloc>(fd_, capacity_);
+            free_array<Talloc>(gen_, capacity_);
+            free_array<Talloc>(state_, capacity_);
+            free_array<Talloc>(active_, capacity_);
+            free_array<Talloc>(index_, nindex_);
+        }
+
+        //! ctor.
+        //! @param capacity    slot count, a multiple of the page size (see alloc_array())
+        explicit connection_table(std::size_t capacity) : fd_(alloc_array<Talloc, int>(&capacity))
+                                                        , gen_(alloc_array<Talloc, std::atomic<std::uint32_t> >(&capacity))
+                                                        , state_(alloc_array<Talloc, std::atomic<std::uint8_t> >(&capacity))
+                                                        , active_(alloc_array<Talloc, std::atomic<std::uint32_t> >(&capacity))
+                                                        , capacity_(capacity)
+                                                        , nindex_(fd_limit())
+                                                        , index_(alloc_array<Talloc, std::atomic<std::uint32_t> >(&nindex_)) {
+
+            for (std::size_t i = 0; i != capacity_; ++i)
+            {
+                new (&gen_[i]) std::atomic<std::uint32_t>(1);
+                new (&state_[i]) std::atomic<std::uint8_t>(CLIENT_BUSY);
+                new (&active_[i]) std::atomic<std::uint32_t>(0);
+            }
+        }
+
+        //! Socket of a slot, 0 when unused
+        int* fd() const {
+            return fd_;
+        }
+
+        //! Generation of a slot, advanced when its connection closes; never 0, so no key is 0 (the
+        //! epoll control event), and below 2^31, so no key carries WATCHER_TAG
+        std::atomic<std::uint32_t>* gen() const {
+            return gen_;
+        }
+
+        //! client_state of a slot
+        std::atomic<std::uint8_t>* state() const {
+            return state_;
+        }
+
+        //! Coarse clock of a slot's last event, msec
+        std::atomic<std::uint32_t>* active() const {
+            return active_;
+        }
+
+        //! Marks a slot unused and advances its generation
+        //! @param slot    client slot
+        void retire(const std::uint32_t slot) {
+
+            fd_[slot] = 0;
+            state_[slot].store(CLIENT_BUSY, std::memory_order_relaxed);
+
+            const std::uint32_t gen = (gen_[slot].load(std::memory_order_relaxed) + 1) & 0x7fffffff;
+            gen_[slot].store(gen ? gen : 1, std::memory_order_release);
+        }
+
+        //! Maps a socket to a slot; sockets past RLIMIT_NOFILE at construction aren't indexed
+        //! @param sfd     socket file descriptor
+        //! @param slot    client slot
+        void index(const int sfd, const std::uint32_t slot) {
+            if (static_cast<std::size_t>(sfd) < nindex_)
+                index_[sfd].store(slot + 1, std::memory_order_release);
+        }
+
+        //! Removes a socket from the index, before it is closed and its number reused
+        //! @param sfd    socket file descriptor
+        void unindex(const int sfd) {
+            if (static_cast<std::size_t>(sfd) < nindex_)
+                index_[sfd].store(0, std::memory_order_release);
+        }
+
+        //! Finds the connection on a socket, lock-free
+        //! @param sfd    socket file descriptor
+        connection_ref find(const int sfd) const {
+
+            connection_ref ref = { 0, 0 };
+            if (sfd < 0 || static_cast<std::size_t>(sfd) >= nindex_)
+                return ref;
+
+            std::uint32_t entry = index_[sfd].load(std::memory_order_acquire);
+            while (entry)
+            {
+                // The generation belongs to the connection if the entry didn't change meanwhile
+                const std::uint32_t gen = gen_[entry - 1].load(std::memory_order_acquire);
+                const std::uint32_t again = index_[sfd].load(std::memory_order_acquire);
+
+                if (again == entry)
+                {
+                    ref.slot = entry - 1;
+                    ref.gen = gen;
+                    break;
+                }
+
+                entry = again;
+            }
+
+            return ref;
+        }
+
+        //! Checks that a referenced connection is still open
+        //! @param ref    reference from find()
+        bool alive(const connection_ref& ref) const {
+            return ref.valid() && gen_[ref.slot].load(std::memory_order_acquire) == ref.gen;
+        }
+
+        std::size_t capacity() const {
+            return capacity_;
+        }
+
+        //! Packs a slot and its generation into epoll event data
+        static std::uint64_t key(const std::uint32_t slot, const std::uint32_t gen) {
+            return (static_cast<std::uint64_t>(gen) << 32) | slot;
+        }
+
+        static std::uint32_t key_slot(const std::uint64_t key) {
+            return static_cast<std::uint32_t>(key);
+        }
+
+        static std::uint32_t key_gen(const std::uint64_t key) {
+            return static_cast<std::uint32_t>(key >> 32);
+        }
+
+    private:
+
+        int* fd_;
+        std::atomic<std::uint32_t>* gen_;
+        std::atomic<std::uint8_t>* state_;
+        std::atomic<std::uint32_t>* active_;
+
+        std::size_t capacity_;
+
+        // Slot + 1 by socket, 0 for none; zero-filled pages are empty entries and stay untouched until used
+        std::size_t nindex_;
+        std::atomic<std::uint32_t>* index_;
+
+        /*! Impl.
+         */
+        static std::size_t fd_limit() {
+
+            struct rlimit rl;
+            if (::getrlimit(RLIMIT_NOFILE, &rl) == -1 || rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > MAX_FD_INDEX)
+                return MAX_FD_INDEX;
+
+            return rl.rlim_cur;
+        }
+
+        // Non-copyable object
+        explicit connection_table(connection_table&) = delete;
+        explicit connection_table(const connection_table&) = delete;
+    };
+}
+
+#endif
@@ -1,9 +1,11 @@
 /* echo.cpp -- v1.0 -- an echo server application
    Author: Sam Y. 2021-22 */
 
+#include <cstdlib>
 #include <cstring>
 #include <memory>
 
+#include "metrics.hpp"
 #include "server.hpp"
 
 namespace {
@@ -60,8 +62,10 @@ int main()
     }
 
     typedef comm::server<echo> server;
+    typedef comm::server<comm::metrics_handler> admin;
 
     std::shared_ptr<server> sv;
+    std::shared_ptr<admin> ad;
 
     try
     {
@@ -71,6 +75,46 @@ int main()
         if (!sv->add(svfd)) {
             return perror(""), 1;
         }
+
+        // RTT, retransmits and cwnd sampled every Nth read, e.g. ECHO_TCP_INFO=16
+        const char* tcpinfo = std::getenv("ECHO_TCP_INFO");
+        if (tcpinfo && std::atoi(tcpinfo) > 0) {
+            sv->clients().sample_tcp_info(static_cast<unsigned>(std::atoi(tcpinfo)));
+        }
+        // Kernel-to-callback delay, e.g. ECHO_TIMESTAMPS=1; reads then go through recvmsg()
+        const char* timestamps = std::getenv("ECHO_TIMESTAMPS");
+        if (timestamps && std::atoi(timestamps) != 0) {
+            sv->clients().timestamp_input(true);
+        }
+
+        // Inbound traffic capture for tools/replay, e.g. ECHO_CAPTURE=/tmp/echo.cap
+        const char* capture = std::getenv("ECHO_CAPTURE");
+        if (capture && !sv->clients().capture(capture, 1 << 30)) {
+            return perror("capture file"), 1;
+        }
+
+        // Counters for tools/commtop, e.g. ECHO_STATS=/echo; the segment is recreated, so give each
+        // instance its own name
+        const char* stats = std::getenv("ECHO_STATS");
+        if (stats && !sv->publish(stats)) {
+            return perror("stats segment"), 1;
+        }
+
+        // Prometheus metrics on their own listener and worker, e.g. ECHO_METRICS_PORT=60009 and
+        // curl localhost:60009/metrics. The listener is unauthenticated, bind it only where trusted.
+        // Accept queue depth and socket buffer occupancy are queried through netlink on each scrape
+        const char* metrics = std::getenv("ECHO_METRICS_PORT");
+        if (metrics) {
+
+            const int adminport = std::atoi(metrics);
+
+            ad = std::make_shared<admin>(1, 16, sv->stats(), std::make_shared<comm::sock_diag>(sv->listeners()));
+            ad->clients().name_threads("admin");
+
+            if (!ad->bind(adminport, 16)) {
+                return print_server_socket_error(adminport), 1;
+            }
+        }
     }
 
     catch (std::runtime_error& e) {
@@ -78,7 +122,15 @@ int main()
     }
 
     // Start
+    // Listeners accept on these threads, the pools only name the workers they start
     std::thread t1(&server::run, sv.get());
+    pthread_setname_np(t1.native_handle(), "comm-listen-0");
+
+    std::thread t2;
+    if (ad) {
+        t2 = std::thread(&admin::run, ad.get());
+        pthread_setname_np(t2.native_handle(), "admin-listen-0");
+    }
 
     // 'x' to quit
     int ch;
@@ -88,8 +140,14 @@ int main()
 
     // Stop server
     sv->stop();
+    if (ad) {
+        ad->stop();
+    }
 
     t1.join();
+    if (t2.joinable()) {
+        t2.join();
+    }
     comm::endpoint_close(svfd);
 
     return 0;
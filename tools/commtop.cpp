@@ -0,0 +1,120 @@
+/* commtop.cpp -- v1.0 -- top-like viewer for a published stats segment
+   Author: Sam Y. 2022 */
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <unistd.h>
+
+#include "stats.hpp"
+
+namespace {
+
+    /*! Average of a histogram
+     */
+    double histogram_mean(const comm::histogram& h)
+    {
+        const std::uint64_t count = h.count();
+        return count ? static_cast<double>(h.sum) / count : 0;
+    }
+
+    /*! Prints one row per slot, rates are per second over the last interval
+     */
+    void print(const comm::stats_segment& seg,
+               const std::vector<comm::worker_stats>& prev,
+               const std::vector<comm::worker_stats>& cur,
+               const std::vector<bool>& fresh,
+               const double secs)
+    {
+        const comm::stats_header* const hdr = seg.header();
+
+        std::printf("\033[H\033[2J");
+        std::printf("pid %lld   clients %llu / %llu\n\n",
+                    static_cast<long long>(hdr->pid),
+                    static_cast<unsigned long long>(hdr->clients.load(std::memory_order_relaxed)),
+                    static_cast<unsigned long long>(hdr->clientcap));
+
+        std::printf("%4s %-8s %12s %12s %12s %12s %10s %10s %10s %9s %6s %6s %8s\n",
+                    "SLOT", "ROLE", "LOOPS/s", "EVENTS/s", "READS/s", "MB_IN/s",
+                    "ACCEPT/s", "CLOSE/s", "BATCH", "READ_B", "BUSY%", "CPU%", "PREEMPT/s");
+
+        for (std::size_t i = 0; i != cur.size(); ++i)
+        {
+            const comm::worker_stats& a = prev[i];
+            const comm::worker_stats& b = cur[i];
+
+            // Share of loop wall time spent in callbacks, and thread CPU time over wall time
+            const double wall = static_cast<double>((b.wait_ns - a.wait_ns) + (b.dispatch_ns - a.dispatch_ns));
+            const double busy = wall ? 100.0 * (b.dispatch_ns - a.dispatch_ns) / wall : 0;
+            const double cpu = 100.0 * ((b.user_us - a.user_us) + (b.sys_us - a.sys_us)) / 1e6 / secs;
+
+            std::printf("%4zu %-8s %12.0f %12.0f %12.0f %12.2f %10.0f %10.0f %10.1f %9.0f %6.1f %6.1f %8.0f%s\n",
+                        i,
+                        seg.slots()[i].role == comm::STATS_LISTENER ? "listener" : "worker",
+                        (b.loops - a.loops) / secs,
+                        (b.events - a.events) / secs,
+                        (b.reads - a.reads) / secs,
+                        (b.bytes_in - a.bytes_in) / secs / 1e6,
+                        (b.accepts - a.accepts) / secs,
+                        (b.closes - a.closes) / secs,
+                        histogram_mean(b.batch),
+                        histogram_mean(b.readsize),
+                        busy,
+                        cpu,
+                        (b.ivcsw - a.ivcsw) / secs,
+                        fresh[i] ? "" : " (stale)");
+        }
+
+        std::fflush(stdout);
+    }
+}
+
+/*! Entry point
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <segment name, e.g. /echo> [interval ms]\n", argv[0]);
+        return 1;
+    }
+
+    const int interval = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+    try
+    {
+        // Attaching maps the segment read-only, refreshing never touches the server process
+        comm::stats_segment seg(argv[1]);
+
+        const std::size_t nslots = seg.size();
+        std::vector<comm::worker_stats> prev(nslots), cur(nslots);
+        std::vector<bool> fresh(nslots);
+
+        for (std::size_t i = 0; i != nslots; ++i)
+            comm::stats_read(&seg.slots()[i], &prev[i]);
+
+        while (true)
+        {
+            ::usleep(interval * 1000);
+
+            for (std::size_t i = 0; i != nslots; ++i)
+            {
+                comm::worker_stats snap;
+                if ((fresh[i] = comm::stats_read(&seg.slots()[i], &snap)))
+                    cur[i] = snap;
+                else
+                    cur[i] = prev[i]; // Writer busy, show last snapshot
+            }
+
+            print(seg, prev, cur, fresh, interval / 1000.0);
+            prev = cur;
+        }
+    }
+
+    catch (std::runtime_error& e) {
+        return std::perror(e.what()), 1;
+    }
+
+    return 0;
+}
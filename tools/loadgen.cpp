@@ -0,0 +1,361 @@
+/* loadgen.cpp -- v1.0 -- load generator with slow-client and slowloris scenarios against an in-process echo server
+   Author: Sam Y. 2022 */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <malloc.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "diag.hpp"
+#include "server.hpp"
+
+namespace {
+
+    /*! @class echo
+     *  packet handler under test
+     */
+    class echo : public comm::client_callback_handler<echo> {
+    public:
+
+        inline echo(const std::size_t nworkers,
+                    const std::size_t size) : comm::client_callback_handler<echo>(nworkers, size) {  }
+
+        inline void on_input(int sfd, char* data, int datalen) {
+            comm::endpoint_write(sfd, data, datalen);
+        }
+    };
+
+    typedef comm::server<echo> server;
+
+    /*! Misbehaving client types
+     */
+    enum attack {
+        NONE,
+        DRIP,         // sends one byte per connection every DRIP_INTERVAL, never completes anything
+        ZERO_WINDOW,  // sends continuously, never reads, so the server's responses back up
+        HALF_OPEN     // connects and goes silent, like a peer that vanished without a FIN
+    };
+
+    static const char* const attack_names[] = { "baseline", "drip", "zero-window", "half-open" };
+
+    static const int DRIP_INTERVAL = 100;   // msec
+    static const int TICK = 10;             // msec
+    static const int GOOD_CLIENTS = 16;
+    static const int MESSAGE_SIZE = 512;
+
+    /*! Connects to the local port, -1 on failure
+     */
+    int connect_local(const int port, const int rcvbuf = 0)
+    {
+        const int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            return -1;
+
+        // Must precede connect() to shrink the advertised window
+        if (rcvbuf)
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+        struct sockaddr_in addr = {  };
+        addr.sin_family = AF_INET;
+        addr.sin_port = ::htons(port);
+        addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+
+        if (::connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == -1)
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        return fd;
+    }
+
+    /*! Drives misbehaving connections until stopped
+     */
+    void attacker(const attack type, const std::vector<int>& fds, const std::atomic<bool>& stop)
+    {
+        std::vector<char> chunk(4096, 'z');
+        std::size_t next = 0;
+
+        // Spread drips evenly over the interval
+        const std::size_t perTick = fds.size() * TICK / DRIP_INTERVAL + 1;
+
+        while (!stop.load())
+        {
+            if (type == DRIP)
+            {
+                for (std::size_t i = 0; i != perTick && !fds.empty(); ++i, next = (next + 1) % fds.size())
+                    ::send(fds[next], "z", 1, MSG_DONTWAIT | MSG_NOSIGNAL);
+            }
+
+            else if (type == ZERO_WINDOW)
+            {
+                for (std::size_t i = 0; i != fds.size(); ++i)
+                    ::send(fds[i], chunk.data(), chunk.size(), MSG_DONTWAIT | MSG_NOSIGNAL);
+            }
+
+            std::this_thread::sleep_for(std::chrono::milliseconds(TICK));
+        }
+    }
+
+    /*! @struct outcome
+     *  measurements for well-behaved clients and server resource usage
+     */
+    struct outcome {
+        std::vector<std::uint64_t> rtts;
+        std::uint64_t bytes;
+        std::uint64_t failures;
+        double elapsed;
+    };
+
+    /*! Lockstep echo round trips on blocking connections until the deadline
+     */
+    void well_behaved(const int port, const int seconds, outcome& out)
+    {
+        std::vector<int> fds;
+        for (int i = 0; i != GOOD_CLIENTS; ++i)
+        {
+            const int fd = connect_local(port);
+            if (fd == -1)
+            {
+                ++out.failures;
+                continue;
+            }
+
+            const int one = 1;
+            struct timeval tv = { 2, 0 };
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+            fds.push_back(fd);
+        }
+
+        const std::vector<char> msg(MESSAGE_SIZE, 'x');
+        char buff[MESSAGE_SIZE];
+
+        const std::uint64_t start = comm::detail::now();
+        const std::uint64_t deadline = start + seconds * 1000000000ULL;
+
+        while (comm::detail::now() < deadline && !fds.empty())
+        {
+            for (std::size_t i = 0; i != fds.size(); ++i)
+            {
+                const std::uint64_t t0 = comm::detail::now();
+
+                if (::send(fds[i], msg.data(), msg.size(), MSG_NOSIGNAL) != MESSAGE_SIZE)
+                {
+                    ++out.failures;
+                    continue;
+                }
+
+                int got = 0;
+                while (got < MESSAGE_SIZE)
+                {
+                    const ssize_t n = ::recv(fds[i], buff, sizeof(buff) - got, 0);
+                    if (n <= 0)
+                        break;
+                    got += n;
+                }
+
+                if (got != MESSAGE_SIZE)
+                {
+                    ++out.failures;
+                    continue;
+                }
+
+                out.rtts.push_back(comm::detail::now() - t0);
+                out.bytes += MESSAGE_SIZE;
+            }
+        }
+
+        out.elapsed = (comm::detail::now() - start) / 1e9;
+
+        for (std::size_t i = 0; i != fds.size(); ++i)
+            ::close(fds[i]);
+    }
+
+    /*! Resident set size of this process in KB, 0 if unavailable
+     */
+    std::uint64_t resident_kb()
+    {
+        FILE* const fp = std::fopen("/proc/self/statm", "r");
+        if (fp == nullptr)
+            return 0;
+
+        unsigned long long size = 0, resident = 0;
+        const int n = std::fscanf(fp, "%llu %llu", &size, &resident);
+        std::fclose(fp);
+
+        return n == 2 ? resident * ::sysconf(_SC_PAGESIZE) / 1024 : 0;
+    }
+
+    /*! Sums the counters of all slots; opens are counted by the listener, the rest by workers
+     */
+    comm::worker_stats totals(const comm::stats_segment& seg, std::vector<comm::worker_stats>& snaps, std::size_t& stale)
+    {
+        comm::worker_stats sum = {  };
+
+        for (std::size_t i = 0; i != seg.size(); ++i)
+        {
+            // A slot whose writer kept publishing through every retry keeps its previous snapshot
+            comm::worker_stats fresh;
+            if (comm::stats_read(&seg.slots()[i], &fresh))
+                snaps[i] = fresh;
+            else
+                ++stale;
+
+            const comm::worker_stats& s = snaps[i];
+
+            sum.opens += s.opens;
+            sum.closes += s.closes;
+            sum.reads += s.reads;
+            sum.bytes_in += s.bytes_in;
+            sum.events += s.events;
+            sum.user_us += s.user_us;
+            sum.sys_us += s.sys_us;
+        }
+
+        return sum;
+    }
+
+    /*! Runs one scenario on a fresh server and prints a result line
+     */
+    void scenario(const attack type, const int nattackers, const int nworkers, const int seconds)
+    {
+        std::shared_ptr<server> sv = std::make_shared<server>(nworkers, nattackers + GOOD_CLIENTS + 64);
+
+        if (!sv->bind(0, 4096))
+        {
+            std::perror("bind");
+            return;
+        }
+
+        const int lfd = sv->listeners().front();
+
+        struct sockaddr_in addr = {  };
+        socklen_t len = sizeof(addr);
+        ::getsockname(lfd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        const int port = ::ntohs(addr.sin_port);
+
+        comm::sock_diag diag(sv->listeners());
+        std::thread t(&server::run, sv.get());
+
+        // Baseline once the workers are up, the misbehaving connections account for the growth; heap the
+        // previous scenario freed goes back to the kernel first, or its reuse would hide the growth
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        ::malloc_trim(0);
+        const std::uint64_t rss = resident_kb();
+
+        // Misbehaving connections first, so the good clients compete with an established load
+        std::vector<int> bad;
+        if (type != NONE)
+        {
+            for (int i = 0; i != nattackers; ++i)
+            {
+                const int fd = connect_local(port, type == ZERO_WINDOW ? 2048 : 0);
+                if (fd != -1)
+                    bad.push_back(fd);
+            }
+        }
+
+        std::atomic<bool> stop(false);
+        std::thread a(attacker, type, std::cref(bad), std::cref(stop));
+
+        // Let the attack reach steady state
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+        std::vector<comm::worker_stats> snaps(sv->stats()->size());
+        std::size_t stale = 0;
+
+        const comm::worker_stats before = totals(*sv->stats(), snaps, stale);
+        const std::uint64_t loaded = resident_kb();
+        const std::uint64_t grown = loaded > rss ? loaded - rss : 0;
+
+        outcome out = {  };
+        well_behaved(port, seconds, out);
+
+        const comm::worker_stats after = totals(*sv->stats(), snaps, stale);
+        diag.refresh();
+
+        stop.store(true);
+        a.join();
+
+        std::sort(out.rtts.begin(), out.rtts.end());
+
+        const double p50 = out.rtts.empty() ? 0 : out.rtts[out.rtts.size() / 2] / 1e3;
+        const double p99 = out.rtts.empty() ? 0 : out.rtts[out.rtts.size() * 99 / 100] / 1e3;
+
+        // Resource usage: process memory grown per misbehaving connection, kernel buffers queued per server socket
+        const std::uint64_t clients = sv->stats()->header()->clients.load(std::memory_order_relaxed);
+        const comm::listener_diag& l = diag.listener(0);
+
+        const double cpu = (after.user_us + after.sys_us - before.user_us - before.sys_us) / (out.elapsed * 1e4);
+
+        std::printf("%-12s %6zu %9.0f %8.1f %8.1f %6llu | %6llu %8.1f %7.0f %9.0f %5.0f%% | %6llu %9.1f %9.1f%s\n",
+                    attack_names[type],
+                    bad.size(),
+                    out.rtts.size() / out.elapsed,
+                    p50,
+                    p99,
+                    static_cast<unsigned long long>(out.failures),
+                    static_cast<unsigned long long>(clients),
+                    bad.empty() ? 0.0 : static_cast<double>(grown) / bad.size(),
+                    (after.reads - before.reads) / out.elapsed,
+                    (after.events - before.events) / out.elapsed,
+                    cpu,
+                    static_cast<unsigned long long>(l.conns),
+                    l.conns ? l.rxqueue.sum / 1024.0 / l.conns : 0.0,
+                    l.conns ? l.txqueue.sum / 1024.0 / l.conns : 0.0,
+                    stale ? " (stale)" : "");
+
+        for (std::size_t i = 0; i != bad.size(); ++i)
+            ::close(bad[i]);
+
+        sv->stop();
+        t.join();
+        comm::endpoint_close(lfd);
+    }
+}
+
+/*! Entry point
+ *  usage: loadgen [attackers] [seconds] [workers]
+ */
+int main(int argc, char** argv)
+{
+    const int nattackers = argc > 1 ? std::atoi(argv[1]) : 2000;
+    const int seconds = argc > 2 ? std::atoi(argv[2]) : 3;
+    const int nworkers = argc > 3 ? std::atoi(argv[3]) : 2;
+
+    ::signal(SIGPIPE, SIG_IGN);
+
+    // Each connection costs two descriptors in-process
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    std::printf("%-12s %6s %9s %8s %8s %6s | %6s %8s %7s %9s %6s | %6s %9s %9s\n",
+                "SCENARIO", "BAD", "GOOD_RT/s", "P50_us", "P99_us", "FAIL",
+                "CONNS", "RSS_KB/c", "READS/s", "EVENTS/s", "CPU",
+                "KCONNS", "RXQ_KB/c", "TXQ_KB/c");
+
+    for (int type = NONE; type <= HALF_OPEN; ++type)
+        scenario(static_cast<attack>(type), nattackers, nworkers, seconds);
+
+    return 0;
+}
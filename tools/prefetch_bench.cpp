@@ -0,0 +1,161 @@
+/* prefetch_bench.cpp -- v1.0 -- dispatch cost of large epoll batches over many connections, by prefetch distance
+   Author: Sam Y. 2022 */
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <signal.h>
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+#include "server.hpp"
+
+namespace {
+
+    // Blocks the worker while a batch is queued, so it is dispatched as one epoll_wait() result
+    std::atomic<int> gatefd(-1);
+    std::atomic<bool> gated(false), released(false);
+
+    std::atomic<std::uint64_t> handled(0);
+
+    /*! @class sink
+     *  counts inputs, holds the worker on the gate connection
+     */
+    class sink : public comm::client_callback_handler<sink> {
+    public:
+
+        inline sink(const std::size_t nworkers,
+                    const std::size_t size) : comm::client_callback_handler<sink>(nworkers, size) {  }
+
+        inline void on_input(int sfd, char*, int) {
+
+            if (sfd != gatefd.load())
+            {
+                handled.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+
+            gated.store(true);
+            while (!released.load())
+                std::this_thread::yield();
+        }
+    };
+
+    // Touched between rounds so each batch starts with cold caches
+    static const std::size_t EVICT_SIZE = 64 << 20;
+
+    /*! Runs rounds of one batch over all connections, returns the median nsec per event
+     */
+    double measure(const int nconns, const int rounds, const int distance, const bool buffers)
+    {
+        sink pool(1, nconns + 1);
+        pool.read_sizing(256, 256);
+        pool.prefetch_ahead(distance, buffers);
+
+        std::vector<int> peers;
+        for (int i = 0; i != nconns + 1; ++i)
+        {
+            int fds[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, fds) == -1)
+                break;
+
+            if (i == 0)
+                gatefd.store(fds[0]);
+
+            pool.add_client(fds[0]);
+            peers.push_back(fds[1]);
+        }
+
+        const int gate = peers.front();
+        std::vector<int> order(peers.begin() + 1, peers.end());
+
+        std::mt19937 rng(1);
+        std::vector<char> evict(EVICT_SIZE);
+        std::vector<double> samples;
+
+        pool.run();
+
+        for (int r = 0; r != rounds + 1; ++r)
+        {
+            // Hold the worker, queue one byte on every connection in random slot order, then release
+            gated.store(false);
+            released.store(false);
+            handled.store(0);
+
+            (void)::send(gate, "g", 1, MSG_NOSIGNAL);
+            while (!gated.load())
+                std::this_thread::yield();
+
+            std::shuffle(order.begin(), order.end(), rng);
+            for (std::size_t i = 0; i != order.size(); ++i)
+                (void)::send(order[i], "x", 1, MSG_NOSIGNAL);
+
+            for (std::size_t i = 0; i < evict.size(); i += 64)
+                evict[i] += 1;
+
+            const std::uint64_t t0 = comm::detail::now();
+            released.store(true);
+
+            while (handled.load(std::memory_order_relaxed) != order.size())
+                std::this_thread::yield();
+
+            // First round warms up the buffer pools
+            if (r)
+                samples.push_back(static_cast<double>(comm::detail::now() - t0) / order.size());
+        }
+
+        pool.stop();
+
+        for (std::size_t i = 0; i != peers.size(); ++i)
+            ::close(peers[i]);
+
+        std::sort(samples.begin(), samples.end());
+        return samples.empty() ? 0 : samples[samples.size() / 2];
+    }
+}
+
+/*! Entry point
+ *  usage: prefetch_bench [connections] [rounds]
+ *  connections are capped by RLIMIT_NOFILE, two descriptors each
+ */
+int main(int argc, char** argv)
+{
+    int nconns = argc > 1 ? std::atoi(argv[1]) : 100000;
+    const int rounds = argc > 2 ? std::atoi(argv[2]) : 7;
+
+    ::signal(SIGPIPE, SIG_IGN);
+
+    struct rlimit rl;
+    if (::getrlimit(RLIMIT_NOFILE, &rl) == 0)
+    {
+        rl.rlim_cur = rl.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &rl);
+
+        const long avail = static_cast<long>(rl.rlim_cur) / 2 - 64;
+        if (rl.rlim_cur != RLIM_INFINITY && nconns > avail)
+        {
+            std::printf("RLIMIT_NOFILE %ld allows %ld connections\n", static_cast<long>(rl.rlim_cur), avail);
+            nconns = static_cast<int>(avail);
+        }
+    }
+
+    std::printf("%d connections, one worker, median of %d batches\n", nconns, rounds);
+    std::printf("%-9s %-8s %12s\n", "DISTANCE", "BUFFERS", "NS/EVENT");
+
+    const int distances[] = { 0, 2, 4, 8, 16, 32 };
+    for (int d : distances)
+    {
+        std::printf("%-9d %-8s %12.1f\n", d, "no", measure(nconns, rounds, d, false));
+
+        if (d)
+            std::printf("%-9d %-8s %12.1f\n", d, "yes", measure(nconns, rounds, d, true));
+    }
+
+    return 0;
+}
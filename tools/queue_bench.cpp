@@ -0,0 +1,141 @@
+/* queue_bench.cpp -- v1.0 -- contention benchmark for atomic_queue and the client counter, perf c2c friendly
+   Author: Sam Y. 2022 */
+
+// Instrumented build of the queue
+#define COMM_CONTENTION_STATS
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include "atomic_queue.hpp"
+
+namespace {
+
+    /*! @struct packed
+     *  mirrors client_pool: capacity, client count and unused queue side by side, as in the library
+     */
+    struct packed {
+        std::size_t clientcap;
+        std::atomic<std::size_t> clientsize;
+        comm::atomic_queue<void*> unused;
+
+        explicit packed(std::size_t cap) : clientcap(cap), clientsize(0), unused(cap) {  }
+    };
+
+    /*! @struct padded
+     *  same fields, each on its own cache line, as a baseline
+     */
+    struct padded {
+        alignas(64) std::size_t clientcap;
+        alignas(64) std::atomic<std::size_t> clientsize;
+        alignas(64) comm::atomic_queue<void*> unused;
+
+        explicit padded(std::size_t cap) : clientcap(cap), clientsize(0), unused(cap) {  }
+    };
+
+    /*! Prints field addresses and cache lines, to attribute perf c2c HITM lines to fields
+     */
+    template <typename P>
+    void print_layout(const char* name, const P& p)
+    {
+        const std::uintptr_t base = reinterpret_cast<std::uintptr_t>(&p);
+        const std::uintptr_t fields[] = {
+            reinterpret_cast<std::uintptr_t>(&p.clientcap),
+            reinterpret_cast<std::uintptr_t>(&p.clientsize),
+            reinterpret_cast<std::uintptr_t>(p.unused.head_address()),
+            reinterpret_cast<std::uintptr_t>(p.unused.tail_address())
+        };
+        const char* names[] = { "clientcap", "clientsize", "unused.head_", "unused.tail_" };
+
+        std::printf("%s layout:\n", name);
+        for (int i = 0; i != 4; ++i)
+        {
+            std::printf("  %-14s %#14lx  offset %4lu  line %#14lx\n", names[i],
+                        static_cast<unsigned long>(fields[i]),
+                        static_cast<unsigned long>(fields[i] - base),
+                        static_cast<unsigned long>(fields[i] & ~std::uintptr_t(63)));
+        }
+    }
+
+    /*! Runs the add_client()/unuse() pattern of client_pool on nthreads threads
+     */
+    template <typename P>
+    void run(const char* name, const int nthreads, const int millis)
+    {
+        const std::size_t cap = 4096;
+        P p(cap);
+
+        void** data = p.unused.data();
+        for (std::size_t i = 0; i != p.unused.capacity(); ++i)
+            data[i] = &data[i];
+
+        print_layout(name, p);
+
+        std::atomic<bool> stop(false);
+        std::vector<std::uint64_t> ops(nthreads);
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t != nthreads; ++t)
+        {
+            threads.emplace_back([&p, &stop, &ops, t] {
+
+                std::uint64_t n = 0;
+                while (!stop.load(std::memory_order_relaxed))
+                {
+                    // add_client()
+                    if (p.clientsize.load() == p.clientcap)
+                        continue;
+
+                    ++p.clientsize;
+                    void* const cl = p.unused.dequeue();
+
+                    // unuse()
+                    p.unused.enqueue(cl);
+                    --p.clientsize;
+
+                    ++n;
+                }
+
+                ops[t] = n;
+            });
+        }
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(millis));
+        stop.store(true);
+
+        std::uint64_t total = 0;
+        for (int t = 0; t != nthreads; ++t)
+        {
+            threads[t].join();
+            total += ops[t];
+        }
+
+        const comm::queue_contention c = p.unused.contention();
+
+        std::printf("  %d threads: %.2f Mops/s, %llu roll-over cas failures, %llu roll-over spins\n\n",
+                    nthreads,
+                    total / (millis * 1e3),
+                    static_cast<unsigned long long>(c.cas_failures),
+                    static_cast<unsigned long long>(c.spins));
+
+        p.unused.destroy();
+    }
+}
+
+/*! Entry point
+ *  usage: queue_bench [threads] [millis]
+ *  e.g.   perf c2c record -- tools/queue_bench 8 2000 && perf c2c report --stdio
+ */
+int main(int argc, char** argv)
+{
+    const int nthreads = argc > 1 ? std::atoi(argv[1]) : 4;
+    const int millis = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+    run<packed>("packed", nthreads, millis);
+    run<padded>("padded", nthreads, millis);
+
+    return 0;
+}
@@ -0,0 +1,234 @@
+/* replay.cpp -- v1.0 -- replays a capture file written by client_pool::capture() against a server
+   Author: Sam Y. 2022 */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "capture.hpp"
+
+namespace {
+
+    /*! Connects to the server, -1 on failure
+     */
+    int connect_to(const struct addrinfo* const ai)
+    {
+        const int fd = ::socket(ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd == -1)
+            return -1;
+
+        if (::connect(fd, ai->ai_addr, ai->ai_addrlen) == -1)
+        {
+            ::close(fd);
+            return -1;
+        }
+
+        const int one = 1;
+        ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        return fd;
+    }
+
+    /*! Sends all of data, false on error
+     */
+    bool send_all(const int fd, const char* data, std::size_t len)
+    {
+        while (len)
+        {
+            const ssize_t n = ::send(fd, data, len, MSG_NOSIGNAL);
+            if (n <= 0)
+                return false;
+
+            data += n;
+            len -= n;
+        }
+
+        return true;
+    }
+
+    /*! Discards whatever the server has sent so far, returns bytes read
+     */
+    std::size_t drain(const int fd)
+    {
+        char buff[65536];
+        std::size_t total = 0;
+
+        ssize_t n;
+        while ((n = ::recv(fd, buff, sizeof(buff), MSG_DONTWAIT)) > 0)
+            total += n;
+
+        return total;
+    }
+}
+
+/*! Entry point
+ *  usage: replay <file> <host> <port> [speed]
+ *  speed scales the recorded gaps between records, e.g. 2 replays twice as fast, 0 without pauses
+ */
+int main(int argc, char** argv)
+{
+    if (argc < 4)
+    {
+        std::fprintf(stderr, "usage: %s <file> <host> <port> [speed]\n", argv[0]);
+        return 1;
+    }
+
+    const double speed = argc > 4 ? std::atof(argv[4]) : 1.0;
+
+    struct addrinfo hints = {  };
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo* ai;
+    if (::getaddrinfo(argv[2], argv[3], &hints, &ai) != 0)
+    {
+        std::fprintf(stderr, "cannot resolve %s:%s\n", argv[2], argv[3]);
+        return 1;
+    }
+
+    const int fd = ::open(argv[1], O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd == -1 || ::fstat(fd, &st) == -1 || static_cast<std::size_t>(st.st_size) < sizeof(comm::capture_header))
+    {
+        std::fprintf(stderr, "cannot open capture file %s\n", argv[1]);
+        return 1;
+    }
+
+    void* const mem = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (mem == MAP_FAILED)
+        return perror("mmap"), 1;
+
+    const comm::capture_header* const hdr = static_cast<const comm::capture_header*>(mem);
+    if (hdr->magic != comm::CAPTURE_MAGIC)
+    {
+        std::fprintf(stderr, "%s is not a capture file\n", argv[1]);
+        return 1;
+    }
+
+    if (hdr->dropped.load())
+        std::fprintf(stderr, "warning: %llu records were dropped at capture time\n",
+                     static_cast<unsigned long long>(hdr->dropped.load()));
+
+    const char* const base = static_cast<const char*>(mem);
+    const std::size_t end = std::min<std::uint64_t>(hdr->used.load(), st.st_size);
+
+    // Capture connection id to replay socket
+    std::unordered_map<std::uint32_t, int> conns;
+
+    std::uint64_t nrecords = 0, nconns = 0, sent = 0, received = 0, failed = 0;
+    std::uint64_t first = 0, last = 0;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    std::size_t off = sizeof(comm::capture_header);
+    while (off + sizeof(comm::capture_record) <= end)
+    {
+        const comm::capture_record* const rec = reinterpret_cast<const comm::capture_record*>(base + off);
+
+        // Writer was interrupted before completing this record; data records are never empty
+        const std::uint32_t size = __atomic_load_n(&rec->size, __ATOMIC_ACQUIRE);
+        if (size == 0)
+            break;
+
+        const std::uint32_t type = size & comm::CAPTURE_TYPE_MASK;
+        const std::uint32_t len = size & ~comm::CAPTURE_TYPE_MASK;
+        const char* const data = reinterpret_cast<const char*>(rec + 1);
+
+        if (off + sizeof(comm::capture_record) + len > end)
+            break;
+
+        off += sizeof(comm::capture_record) + ((len + 7) & ~7u);
+        ++nrecords;
+
+        // Keep the recorded pacing; concurrent writers can store records slightly out of time order,
+        // a record stamped before the latest one seen is sent right away
+        if (first == 0)
+            first = last = rec->ts;
+
+        if (rec->ts > last)
+        {
+            last = rec->ts;
+
+            if (speed > 0)
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(
+                    static_cast<std::uint64_t>((last - first) / speed)));
+        }
+
+        std::unordered_map<std::uint32_t, int>::iterator it = conns.find(rec->conn);
+
+        if (type == comm::CAPTURE_CLOSE)
+        {
+            if (it != conns.end())
+            {
+                received += drain(it->second);
+                ::close(it->second);
+                conns.erase(it);
+            }
+
+            continue;
+        }
+
+        // Data for a connection opened before the capture started is replayed on a new one
+        if (it == conns.end())
+        {
+            const int sfd = connect_to(ai);
+            if (sfd == -1)
+            {
+                ++failed;
+                continue;
+            }
+
+            it = conns.insert(std::make_pair(rec->conn, sfd)).first;
+            ++nconns;
+        }
+
+        if (type == comm::CAPTURE_DATA)
+        {
+            if (send_all(it->second, data, len))
+                sent += len;
+            else
+                ++failed;
+
+            received += drain(it->second);
+        }
+    }
+
+    // Close what was still open when the capture ended
+    for (std::unordered_map<std::uint32_t, int>::iterator it = conns.begin(); it != conns.end(); ++it)
+    {
+        received += drain(it->second);
+        ::close(it->second);
+    }
+
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::printf("%llu records, %llu connections, %llu bytes sent, %llu bytes received, %llu failures in %.3fs\n",
+                static_cast<unsigned long long>(nrecords),
+                static_cast<unsigned long long>(nconns),
+                static_cast<unsigned long long>(sent),
+                static_cast<unsigned long long>(received),
+                static_cast<unsigned long long>(failed),
+                elapsed);
+
+    ::munmap(mem, st.st_size);
+    ::freeaddrinfo(ai);
+
+    return failed ? 2 : 0;
+}
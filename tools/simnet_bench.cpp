@@ -0,0 +1,259 @@
+/* simnet_bench.cpp -- v1.0 -- scripted echo scenarios over the simulated network
+   Author: Sam Y. 2022 */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <signal.h>
+
+#include "server.hpp"
+#include "simnet.hpp"
+
+namespace {
+
+    /*! @class echo
+     *  packet handler under test
+     */
+    class echo : public comm::client_callback_handler<echo> {
+    public:
+
+        inline echo(const std::size_t nworkers,
+                    const std::size_t size) : comm::client_callback_handler<echo>(nworkers, size) {  }
+
+        inline void on_input(int sfd, char* data, int datalen) {
+            comm::endpoint_write(sfd, data, datalen);
+        }
+    };
+
+    static const std::uint64_t MSEC = 1000000;
+    static const std::uint64_t TIMEOUT = 10000 * MSEC;
+
+    /*! Prints round trip percentiles, usec
+     */
+    void report(const char* name, std::vector<std::uint64_t>& rtts, const std::uint64_t elapsed, const std::uint64_t bytes)
+    {
+        if (rtts.empty())
+        {
+            std::printf("%-14s no round trips completed\n", name);
+            return;
+        }
+
+        std::sort(rtts.begin(), rtts.end());
+
+        std::printf("%-14s %7zu rtts  p50 %8.1f  p99 %8.1f  max %8.1f usec  %8.2f MB/s\n",
+                    name,
+                    rtts.size(),
+                    rtts[rtts.size() / 2] / 1e3,
+                    rtts[rtts.size() * 99 / 100] / 1e3,
+                    rtts.back() / 1e3,
+                    elapsed ? bytes * 1e3 / elapsed : 0.0);
+    }
+
+    /*! Runs lockstep echo round trips on a set of links, appends their round trip times
+     */
+    std::uint64_t round_trips(comm::sim_network& net,
+                              const std::vector<int>& links,
+                              const int rounds,
+                              const std::size_t size,
+                              std::vector<std::uint64_t>& rtts)
+    {
+        const std::vector<char> msg(size, 'x');
+        std::vector<std::uint64_t> expect(links.size());
+
+        for (std::size_t i = 0; i != links.size(); ++i)
+            expect[i] = net.delivered(links[i]);
+
+        std::uint64_t bytes = 0;
+        for (int r = 0; r != rounds; ++r)
+        {
+            const std::uint64_t t0 = comm::detail::now();
+
+            for (std::size_t i = 0; i != links.size(); ++i)
+            {
+                net.send(links[i], msg.data(), msg.size());
+                expect[i] += size;
+            }
+
+            for (std::size_t i = 0; i != links.size(); ++i)
+            {
+                if (!net.wait_delivered(links[i], expect[i], TIMEOUT))
+                    continue;
+
+                rtts.push_back(net.last_delivery(links[i]) - t0);
+                bytes += size;
+            }
+        }
+
+        return bytes;
+    }
+
+    /*! Opens n links with the given profile
+     */
+    std::vector<int> open_links(comm::sim_network& net, echo& pool, const int n, const comm::sim_profile& profile)
+    {
+        std::vector<int> links;
+        for (int i = 0; i != n; ++i)
+        {
+            const int id = net.connect(pool, profile);
+            if (id != -1)
+                links.push_back(id);
+        }
+
+        return links;
+    }
+
+    /*! Closes a set of links
+     */
+    void close_links(comm::sim_network& net, const std::vector<int>& links)
+    {
+        for (std::size_t i = 0; i != links.size(); ++i)
+            net.close(links[i]);
+    }
+
+    /*! Uniform clients, 1ms latency
+     */
+    void baseline(comm::sim_network& net, echo& pool)
+    {
+        const std::vector<int> links = open_links(net, pool, 64, comm::sim_profile(MSEC, 100 << 20));
+
+        std::vector<std::uint64_t> rtts;
+        const std::uint64_t t0 = comm::detail::now();
+        const std::uint64_t bytes = round_trips(net, links, 20, 512, rtts);
+
+        report("baseline", rtts, comm::detail::now() - t0, bytes);
+        close_links(net, links);
+    }
+
+    /*! Fast clients sharing the pool with clients that send a lot and read slowly
+     */
+    void slow_clients(comm::sim_network& net, echo& pool)
+    {
+        const std::vector<int> fast = open_links(net, pool, 64, comm::sim_profile(MSEC, 100 << 20));
+        const std::vector<int> slow = open_links(net, pool, 8, comm::sim_profile(50 * MSEC, 64 << 10, 0.0, 0, 16 << 10));
+
+        // Slow clients upload 256KB each; echoes back up in the server's sockets
+        const std::vector<char> bulk(256 << 10, 'y');
+        for (std::size_t i = 0; i != slow.size(); ++i)
+            net.send(slow[i], bulk.data(), bulk.size());
+
+        std::vector<std::uint64_t> rtts;
+        const std::uint64_t t0 = comm::detail::now();
+        const std::uint64_t bytes = round_trips(net, fast, 20, 512, rtts);
+
+        report("slow-clients", rtts, comm::detail::now() - t0, bytes);
+        close_links(net, fast);
+        close_links(net, slow);
+    }
+
+    /*! Many clients connecting and sending at once
+     */
+    void burst(comm::sim_network& net, echo& pool)
+    {
+        const std::uint64_t t0 = comm::detail::now();
+        const std::vector<int> links = open_links(net, pool, 512, comm::sim_profile(MSEC, 100 << 20));
+
+        std::vector<std::uint64_t> rtts;
+        const std::uint64_t bytes = round_trips(net, links, 1, 1024, rtts);
+
+        report("burst", rtts, comm::detail::now() - t0, bytes);
+        close_links(net, links);
+    }
+
+    /*! Few clients streaming large uploads
+     */
+    void bulk(comm::sim_network& net, echo& pool)
+    {
+        const std::vector<int> links = open_links(net, pool, 8, comm::sim_profile(MSEC, 0, 0.0, 0, 1 << 20));
+
+        std::vector<std::uint64_t> rtts;
+        const std::uint64_t t0 = comm::detail::now();
+        const std::uint64_t bytes = round_trips(net, links, 16, 64 << 10, rtts);
+
+        report("bulk", rtts, comm::detail::now() - t0, bytes);
+        close_links(net, links);
+    }
+
+    /*! Prints reads and bytes per read over all workers
+     */
+    void report_reads(const comm::stats_segment& seg)
+    {
+        std::uint64_t reads = 0, bytes = 0;
+        std::size_t stale = 0;
+
+        for (std::size_t i = 0; i != seg.size(); ++i)
+        {
+            // No earlier snapshot to fall back on, a slot that stays busy is left out and reported
+            comm::worker_stats s;
+            if (!comm::stats_read(&seg.slots()[i], &s))
+            {
+                ++stale;
+                continue;
+            }
+
+            reads += s.reads;
+            bytes += s.bytes_in;
+        }
+
+        std::printf("%llu reads, %.0f bytes per read",
+                    static_cast<unsigned long long>(reads),
+                    reads ? static_cast<double>(bytes) / reads : 0.0);
+
+        if (stale)
+            std::printf(" (%zu slots busy, not counted)", stale);
+
+        std::printf("\n");
+    }
+
+    /*! Uniform clients over a lossy link
+     */
+    void lossy(comm::sim_network& net, echo& pool)
+    {
+        const std::vector<int> links = open_links(net, pool, 64, comm::sim_profile(MSEC, 100 << 20, 0.01, 20 * MSEC));
+
+        std::vector<std::uint64_t> rtts;
+        const std::uint64_t t0 = comm::detail::now();
+        const std::uint64_t bytes = round_trips(net, links, 20, 4096, rtts);
+
+        report("lossy", rtts, comm::detail::now() - t0, bytes);
+        close_links(net, links);
+    }
+}
+
+/*! Entry point
+ *  usage: simnet_bench [workers] [seed] [adaptive]
+ *  adaptive 1 sizes reads between 256 bytes and 64 KiB, 2 also uses FIONREAD
+ */
+int main(int argc, char** argv)
+{
+    const int nworkers = argc > 1 ? std::atoi(argv[1]) : 2;
+    const std::uint32_t seed = argc > 2 ? std::atoi(argv[2]) : 1;
+    const int adaptive = argc > 3 ? std::atoi(argv[3]) : 0;
+
+    // Closed simulated clients must not kill the process
+    ::signal(SIGPIPE, SIG_IGN);
+
+    echo pool(nworkers, 4096);
+    comm::sim_network net(seed);
+
+    if (adaptive)
+        pool.read_sizing(256, 1 << 16, adaptive == 2);
+
+    pool.run();
+    net.run();
+
+    baseline(net, pool);
+    slow_clients(net, pool);
+    burst(net, pool);
+    lossy(net, pool);
+    bulk(net, pool);
+
+    std::printf("%llu segments lost\n", static_cast<unsigned long long>(net.lost()));
+    report_reads(*pool.stats());
+
+    net.stop();
+    pool.stop();
+
+    return 0;
+}
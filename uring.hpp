@@ -0,0 +1,273 @@
+/* uring.hpp -- v1.0 -- batched socket closes through a raw io_uring instance
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_URING_HPP
+#define _COMM_URING_HPP
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+namespace comm {
+
+    //! @class close_ring
+    /*! io_uring submission and completion rings used for one thread's closes, set up with the raw
+     *  system calls. Closes are queued as IORING_OP_CLOSE entries and submitted together with one
+     *  io_uring_enter(); async entries are handed to the kernel's worker threads, so the submitter
+     *  doesn't wait for the socket teardown. A ring is only valid if the kernel supports the close
+     *  operation (5.6 and later). A close that fails in the ring is only counted: the descriptor is
+     *  released either way, so its number may already belong to another socket.
+     */
+    class close_ring {
+    public:
+
+        //! dtor.
+        //!
+        ~close_ring() {
+
+            drain();
+
+            if (sqes_ != MAP_FAILED)
+                ::munmap(sqes_, sqesize_);
+            if (cq_ != MAP_FAILED && cq_ != sq_)
+                ::munmap(cq_, cqsize_);
+            if (sq_ != MAP_FAILED)
+                ::munmap(sq_, sqsize_);
+            if (fd_ != -1)
+                ::close(fd_);
+        }
+
+        //! ctor.
+        //! @param entries    submission queue size, rounded up to a power of 2 by the kernel
+        //! @param async      run closes on the kernel's worker threads instead of on submission
+        explicit close_ring(const unsigned entries, const bool async = true) : fd_(-1)
+                                                                             , async_(async)
+                                                                             , sq_(MAP_FAILED)
+                                                                             , cq_(MAP_FAILED)
+                                                                             , sqes_(MAP_FAILED)
+                                                                             , sqesize_(0)
+                                                                             , sqsize_(0)
+                                                                             , cqsize_(0)
+                                                                             , queued_(0)
+                                                                             , inflight_(0)
+                                                                             , failed_(0) {
+
+            struct io_uring_params params;
+            std::memset(&params, 0, sizeof(params));
+
+            if ((fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params))) == -1)
+                return;
+
+            if (!supports_close())
+            {
+                ::close(fd_);
+                fd_ = -1;
+                return;
+            }
+
+            sqsize_ = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+            cqsize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+            // Both rings share one mapping on kernels that allow it
+            const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single && cqsize_ > sqsize_)
+                sqsize_ = cqsize_;
+
+            sq_ = ::mmap(nullptr, sqsize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQ_RING);
+            cq_ = single ? sq_ : ::mmap(nullptr, cqsize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_CQ_RING);
+
+            sqesize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+            sqes_ = ::mmap(nullptr, sqesize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES);
+
+            if (sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes_ == MAP_FAILED)
+            {
+                ::close(fd_);
+                fd_ = -1;
+                return;
+            }
+
+            char* const sq = static_cast<char*>(sq_);
+            sqhead_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.head);
+            sqtail_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.tail);
+            sqmask_ = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+            sqentries_ = params.sq_entries;
+            sqarray_ = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+
+            char* const cq = static_cast<char*>(cq_);
+            cqhead_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.head);
+            cqtail_ = reinterpret_cast<std::uint32_t*>(cq + params.cq_off.tail);
+            cqmask_ = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+        }
+
+        //! Checks whether the ring was set up, otherwise close with close()
+        bool valid() const {
+            return fd_ != -1;
+        }
+
+        //! Queues a close, submitting the queue first if it is full
+        //! @param sfd    file descriptor
+        //! @return       false if the ring couldn't take it
+        bool close(const int sfd) {
+
+            if (fd_ == -1)
+                return false;
+
+            std::uint32_t tail = *sqtail_;
+            if (tail - load(sqhead_) == sqentries_)
+            {
+                submit();
+                if (tail - load(sqhead_) == sqentries_)
+                    return false;
+            }
+
+            const std::uint32_t index = tail & sqmask_;
+
+            struct io_uring_sqe* const sqe = static_cast<struct io_uring_sqe*>(sqes_) + index;
+            std::memset(sqe, 0, sizeof(*sqe));
+            sqe->opcode = IORING_OP_CLOSE;
+            sqe->fd = sfd;
+            sqe->flags = async_ ? IOSQE_ASYNC : 0;
+            sqe->user_data = static_cast<std::uint64_t>(sfd);
+
+            sqarray_[index] = index;
+            store(sqtail_, tail + 1);
+
+            ++queued_;
+            return true;
+        }
+
+        //! Submits queued closes without waiting for them, and reaps completed ones
+        //!
+        void submit() {
+            if (queued_)
+                enter(0);
+            else if (inflight_)
+                reap();
+        }
+
+        //! Closes that completed with an error, e.g. EIO from the protocol's release
+        //!
+        std::uint64_t failed() const {
+            return failed_;
+        }
+
+        //! Submits queued closes and waits until all have completed
+        //!
+        void drain() {
+            while (fd_ != -1 && (queued_ || inflight_))
+            {
+                if (enter(inflight_ + queued_) == -1 && errno != EINTR)
+                    break;
+            }
+        }
+
+    private:
+
+        int fd_;
+        bool async_;
+
+        // Ring mappings
+        void* sq_;
+        void* cq_;
+        void* sqes_;
+        std::size_t sqesize_;
+        std::size_t sqsize_;
+        std::size_t cqsize_;
+
+        std::uint32_t* sqhead_;
+        std::uint32_t* sqtail_;
+        std::uint32_t sqmask_;
+        std::uint32_t sqentries_;
+        std::uint32_t* sqarray_;
+
+        std::uint32_t* cqhead_;
+        std::uint32_t* cqtail_;
+        std::uint32_t cqmask_;
+        struct io_uring_cqe* cqes_;
+
+        // Entries queued but not submitted, and submitted but not completed
+        unsigned queued_;
+        unsigned inflight_;
+
+        std::uint64_t failed_;
+
+        /*! Impl.
+         */
+        static std::uint32_t load(const std::uint32_t* const p) {
+            return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+        }
+
+        /*! Impl.
+         */
+        static void store(std::uint32_t* const p, const std::uint32_t v) {
+            __atomic_store_n(p, v, __ATOMIC_RELEASE);
+        }
+
+        /*! Submits queued entries, then reaps completions
+         */
+        int enter(const unsigned mincomplete) {
+
+            const unsigned flags = mincomplete ? IORING_ENTER_GETEVENTS : 0;
+            const int ret = static_cast<int>(::syscall(__NR_io_uring_enter, fd_, queued_, mincomplete, flags, nullptr, 0));
+
+            if (ret > 0)
+            {
+                queued_ -= static_cast<unsigned>(ret);
+                inflight_ += static_cast<unsigned>(ret);
+            }
+
+            reap();
+            return ret;
+        }
+
+        /*! Impl.
+         */
+        void reap() {
+
+            std::uint32_t head = *cqhead_;
+            const std::uint32_t tail = load(cqtail_);
+
+            for ( ; head != tail; ++head)
+            {
+                const struct io_uring_cqe& cqe = cqes_[head & cqmask_];
+
+                if (cqe.res < 0)
+                    ++failed_;
+
+                --inflight_;
+            }
+
+            store(cqhead_, head);
+        }
+
+        /*! Probes the kernel for IORING_OP_CLOSE
+         */
+        bool supports_close() const {
+
+            const std::size_t size = sizeof(struct io_uring_probe) + IORING_OP_LAST * sizeof(struct io_uring_probe_op);
+
+            std::vector<char> mem(size, 0);
+            struct io_uring_probe* const probe = reinterpret_cast<struct io_uring_probe*>(mem.data());
+
+            if (::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) == -1)
+                return false;
+
+            return probe->last_op >= IORING_OP_CLOSE && (probe->ops[IORING_OP_CLOSE].flags & IO_URING_OP_SUPPORTED);
+        }
+
+        // Non-copyable object
+        explicit close_ring(close_ring&) = delete;
+        explicit close_ring(const close_ring&) = delete;
+    };
+}
+
+#endif
@@ -0,0 +1,272 @@
+/* watcher.hpp -- v1.0 -- auxiliary descriptors (timers, eventfds, signals, pipes) served by the event loop workers
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_WATCHER_HPP
+#define _COMM_WATCHER_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+
+namespace comm {
+
+    // Marks epoll event data that points to a watcher; client keys and listener data keep it clear
+    static const std::uint64_t WATCHER_TAG = static_cast<std::uint64_t>(1) << 63;
+
+    //! @class fd_watcher
+    /*! descriptor registered with epoll::watch(), dispatched by whichever worker receives its event.
+     *  The typed watchers below derive from it and supply the dispatch function; a watcher is armed
+     *  one-shot and re-armed after its callback, so callbacks of one watcher never run concurrently.
+     *  A callback may unwatch its own watcher, which is then not re-armed; the watcher must not be
+     *  freed or its descriptor closed until the instance has stopped.
+     */
+    class fd_watcher {
+    public:
+
+        template <typename> friend struct epoll;
+
+        //! Descriptor watched
+        int fd() const {
+            return fd_;
+        }
+
+        //! Impl., called by epoll::wait()
+        void dispatch(const std::uint32_t events) {
+            dispatch_(this, events);
+        }
+
+    protected:
+
+        typedef void (*dispatch_fn)(fd_watcher*, std::uint32_t);
+
+        //! ctor.
+        //! @param fd          descriptor
+        //! @param dispatch    called with the watcher and its epoll events
+        fd_watcher(const int fd, const dispatch_fn dispatch) : fd_(fd), dispatch_(dispatch), unwatched_(false) {  }
+
+        ~fd_watcher() = default;
+
+        int fd_;
+
+    private:
+
+        dispatch_fn dispatch_;
+
+        // Set by epoll::unwatch(), so the dispatching worker doesn't re-arm the descriptor
+        std::atomic<bool> unwatched_;
+
+        // Non-copyable object
+        explicit fd_watcher(fd_watcher&) = delete;
+        explicit fd_watcher(const fd_watcher&) = delete;
+    };
+
+    //! @class io_watcher
+    /*! a descriptor owned by the application, e.g. a pipe from a subprocess; the callback is called
+     *  as func(fd, events) and should read until EAGAIN or leave the rest for the next event
+     */
+    template <typename Tfunc>
+    class io_watcher : public fd_watcher {
+    public:
+
+        //! ctor.
+        //! @param fd      descriptor, not closed by the watcher
+        //! @param func    callback
+        io_watcher(const int fd, Tfunc func) : fd_watcher(fd, &io_watcher::on_event), func_(std::move(func)) {  }
+
+    private:
+
+        Tfunc func_;
+
+        /*! Impl.
+         */
+        static void on_event(fd_watcher* const w, const std::uint32_t events) {
+            io_watcher* const self = static_cast<io_watcher*>(w);
+            self->func_(self->fd_, events);
+        }
+    };
+
+    //! @class timer_watcher
+    /*! timerfd on CLOCK_MONOTONIC; the callback is called as func(expirations), with the number of
+     *  intervals elapsed since the last call
+     */
+    template <typename Tfunc>
+    class timer_watcher : public fd_watcher {
+    public:
+
+        //! dtor.
+        //!
+        ~timer_watcher() {
+            ::close(fd_);
+        }
+
+        //! ctor.
+        //! @param func        callback
+        //! @param interval    period, nsec, 0 for a single expiration
+        //! @param initial     first expiration, nsec from now, the period if 0
+        timer_watcher(Tfunc func,
+                      const std::uint64_t interval,
+                      const std::uint64_t initial = 0) : fd_watcher(::timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC),
+                                                                    &timer_watcher::on_event)
+                                                       , func_(std::move(func)) {
+            if (fd_ == -1)
+                throw std::runtime_error("failed to create timer descriptor");
+
+            arm(interval, initial);
+        }
+
+        //! Restarts the timer, from any thread
+        //! @param interval    period, nsec, 0 for a single expiration
+        //! @param initial     first expiration, nsec from now, the period if 0; both 0 disarms
+        int arm(const std::uint64_t interval, const std::uint64_t initial = 0) {
+
+            const std::uint64_t first = initial ? initial : interval;
+
+            struct itimerspec spec;
+            spec.it_interval.tv_sec = static_cast<time_t>(interval / 1000000000);
+            spec.it_interval.tv_nsec = static_cast<long>(interval % 1000000000);
+            spec.it_value.tv_sec = static_cast<time_t>(first / 1000000000);
+            spec.it_value.tv_nsec = static_cast<long>(first % 1000000000);
+
+            return ::timerfd_settime(fd_, 0, &spec, nullptr);
+        }
+
+    private:
+
+        Tfunc func_;
+
+        /*! Impl.
+         */
+        static void on_event(fd_watcher* const w, const std::uint32_t) {
+
+            timer_watcher* const self = static_cast<timer_watcher*>(w);
+
+            std::uint64_t expirations;
+            if (::read(self->fd_, &expirations, sizeof(expirations)) == sizeof(expirations))
+                self->func_(expirations);
+        }
+    };
+
+    //! @class event_watcher
+    /*! eventfd for waking the workers from other threads; the callback is called as func(count),
+     *  with the sum of the notifications since the last call
+     */
+    template <typename Tfunc>
+    class event_watcher : public fd_watcher {
+    public:
+
+        //! dtor.
+        //!
+        ~event_watcher() {
+            ::close(fd_);
+        }
+
+        //! ctor.
+        //! @param func    callback
+        explicit event_watcher(Tfunc func) : fd_watcher(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC), &event_watcher::on_event)
+                                           , func_(std::move(func)) {
+            if (fd_ == -1)
+                throw std::runtime_error("failed to create event descriptor");
+        }
+
+        //! Adds to the count and wakes a worker, from any thread
+        //! @param count    added, greater than 0
+        int notify(const std::uint64_t count = 1) {
+            return ::write(fd_, &count, sizeof(count)) == sizeof(count) ? 0 : -1;
+        }
+
+    private:
+
+        Tfunc func_;
+
+        /*! Impl.
+         */
+        static void on_event(fd_watcher* const w, const std::uint32_t) {
+
+            event_watcher* const self = static_cast<event_watcher*>(w);
+
+            std::uint64_t count;
+            if (::read(self->fd_, &count, sizeof(count)) == sizeof(count))
+                self->func_(count);
+        }
+    };
+
+    //! @class signal_watcher
+    /*! signalfd for a set of signals, e.g. SIGHUP to reload configuration; the callback is called
+     *  as func(info) for each signal received. The signals are blocked in the constructing thread,
+     *  so construct it before starting any threads, which inherit the mask; a thread that leaves
+     *  them unblocked still has them delivered the usual way.
+     */
+    template <typename Tfunc>
+    class signal_watcher : public fd_watcher {
+    public:
+
+        //! dtor.
+        //!
+        ~signal_watcher() {
+            ::close(fd_);
+        }
+
+        //! ctor.
+        //! @param func       callback
+        //! @param signals    set of signals, see sigaddset()
+        signal_watcher(Tfunc func, const sigset_t& signals) : fd_watcher(-1, &signal_watcher::on_event)
+                                                            , func_(std::move(func)) {
+
+            if (::pthread_sigmask(SIG_BLOCK, &signals, nullptr) != 0
+                || (fd_ = ::signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+                throw std::runtime_error("failed to create signal descriptor");
+            }
+        }
+
+    private:
+
+        Tfunc func_;
+
+        /*! Impl.
+         */
+        static void on_event(fd_watcher* const w, const std::uint32_t) {
+
+            signal_watcher* const self = static_cast<signal_watcher*>(w);
+
+            struct signalfd_siginfo info;
+            while (::read(self->fd_, &info, sizeof(info)) == sizeof(info))
+                self->func_(static_cast<const struct signalfd_siginfo&>(info));
+        }
+    };
+
+    //! Creates an io_watcher, deducing the callback type (e.g. a lambda)
+    template <typename Tfunc>
+    std::unique_ptr<io_watcher<Tfunc> > watch_fd(const int fd, Tfunc func) {
+        return std::unique_ptr<io_watcher<Tfunc> >(new io_watcher<Tfunc>(fd, std::move(func)));
+    }
+
+    //! Creates a timer_watcher, deducing the callback type
+    template <typename Tfunc>
+    std::unique_ptr<timer_watcher<Tfunc> > watch_timer(const std::uint64_t interval, Tfunc func) {
+        return std::unique_ptr<timer_watcher<Tfunc> >(new timer_watcher<Tfunc>(std::move(func), interval));
+    }
+
+    //! Creates an event_watcher, deducing the callback type
+    template <typename Tfunc>
+    std::unique_ptr<event_watcher<Tfunc> > watch_event(Tfunc func) {
+        return std::unique_ptr<event_watcher<Tfunc> >(new event_watcher<Tfunc>(std::move(func)));
+    }
+
+    //! Creates a signal_watcher, deducing the callback type
+    template <typename Tfunc>
+    std::unique_ptr<signal_watcher<Tfunc> > watch_signals(const sigset_t& signals, Tfunc func) {
+        return std::unique_ptr<signal_watcher<Tfunc> >(new signal_watcher<Tfunc>(std::move(func), signals));
+    }
+}
+
+#endif
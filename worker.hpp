@@ -0,0 +1,144 @@
+/* worker.hpp -- v1.0 -- per-thread event loop context
+   Author: Sam Y. 2022 */
+
+#ifndef _COMM_WORKER_HPP
+#define _COMM_WORKER_HPP
+
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <utility>
+#include <vector>
+
+#include <pthread.h>
+
+#include <sys/resource.h>
+
+#include "arena.hpp"
+#include "client.hpp"
+#include "stats.hpp"
+
+namespace comm {
+
+    //! @struct retired_client
+    /*! closed client awaiting reuse; its socket is kept open until then, so the number isn't reused
+     *  while another thread may still address the connection by it
+     */
+    struct retired_client {
+        std::uint64_t epoch;
+        client* cl;
+        int sfd;
+    };
+
+    //! @struct worker
+    /*! state owned by one event loop thread
+     */
+    struct worker {
+
+        // Index within the owning pool
+        int id;
+        // Published counters, written only by this thread
+        stats_slot* stats;
+        // Counters as they are updated, see stats_publish()
+        worker_stats counters;
+        // Handler scratch memory, reset after each event
+        arena scratch;
+        // Connection whose event is being processed
+        client* conn;
+        // Closed clients by retire epoch, reused and their sockets closed once every worker has passed a
+        // later quiescent point
+        std::deque<retired_client> retired;
+        // Sockets of reused clients, closed together before the next epoll_wait() when batching closes
+        std::vector<int> closing;
+
+        explicit worker(const int i = 0, stats_slot* s = nullptr) : id(i), stats(s), counters(), conn(nullptr) {  }
+    };
+
+    namespace detail {
+        /*! Impl.
+         */
+        inline worker*& current_worker() {
+            static thread_local worker* w = nullptr;
+            return w;
+        }
+
+        /*! Monotonic clock, nsec
+         */
+        inline std::uint64_t now() {
+            struct timespec ts;
+            ::clock_gettime(CLOCK_MONOTONIC, &ts);
+            return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+        }
+
+        /*! Coarse monotonic clock, msec; wraps after 49 days, compare by difference
+         */
+        inline std::uint32_t coarse_msec() {
+            struct timespec ts;
+            ::clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+            return static_cast<std::uint32_t>(static_cast<std::uint64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+        }
+
+        /*! Records CPU time and context switches of the calling thread
+         */
+        inline void sample_usage(worker_stats& st) {
+
+            struct rusage ru;
+            if (::getrusage(RUSAGE_THREAD, &ru) == -1)
+                return;
+
+            st.user_us = static_cast<std::uint64_t>(ru.ru_utime.tv_sec) * 1000000 + ru.ru_utime.tv_usec;
+            st.sys_us = static_cast<std::uint64_t>(ru.ru_stime.tv_sec) * 1000000 + ru.ru_stime.tv_usec;
+            st.vcsw = ru.ru_nvcsw;
+            st.ivcsw = ru.ru_nivcsw;
+        }
+
+        /*! Names the calling thread, e.g. "comm-worker-3", shown by top -H and perf
+         */
+        inline void name_thread(const char* prefix, const char* role, const int id) {
+
+            char name[16]; // Kernel limit, including terminator
+            std::snprintf(name, sizeof(name), "%s-%s-%d", prefix, role, id);
+            ::pthread_setname_np(::pthread_self(), name);
+        }
+
+        /*! Counters of the calling thread, discarded if called outside of an event loop
+         */
+        inline worker_stats& stats() {
+            static thread_local worker_stats discard;
+
+            worker* const w = current_worker();
+            return w ? w->counters : discard;
+        }
+    }
+
+    //! Returns the calling thread's event loop context
+    //! @return    worker, nullptr if not called from an event loop thread
+    inline worker* this_worker() {
+        return detail::current_worker();
+    }
+
+    //! Returns the calling worker's scratch arena, reset once the current event has been processed.
+    //! Outside of an event loop this is a thread-local arena that is never reset automatically.
+    inline arena& scratch() {
+        static thread_local arena fallback;
+
+        worker* const w = detail::current_worker();
+        return w ? w->scratch : fallback;
+    }
+
+    //! Returns the arena of the connection being processed, freed when the connection closes
+    //! @return    arena, nullptr if not called from a client callback
+    inline arena* connection_arena() {
+
+        worker* const w = detail::current_worker();
+        if (w == nullptr || w->conn == nullptr)
+            return nullptr;
+
+        if (w->conn->scratch == nullptr)
+            w->conn->scratch = new arena(CONNECTION_ARENA_CHUNK_SIZE);
+
+        return w->conn->scratch;
+    }
+}
+
+#endif